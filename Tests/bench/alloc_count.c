@@ -0,0 +1,39 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+
+// Preloaded library counting heap allocations of a program.
+// Build: gcc -O2 -shared -fPIC alloc_count.c -o alloc_count.so
+// Run:   LD_PRELOAD=./alloc_count.so ./ppcbc ...
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *pointer, size_t size);
+
+static unsigned long long allocations;  // malloc and calloc calls.
+static unsigned long long reallocations;  // realloc calls.
+
+
+void *malloc(size_t size){
+    __atomic_add_fetch(&allocations, 1, __ATOMIC_RELAXED);
+    return __libc_malloc(size);
+}
+
+
+void *calloc(size_t count, size_t size){
+    __atomic_add_fetch(&allocations, 1, __ATOMIC_RELAXED);
+    return __libc_calloc(count, size);
+}
+
+
+void *realloc(void *pointer, size_t size){
+    __atomic_add_fetch(&reallocations, 1, __ATOMIC_RELAXED);
+    return __libc_realloc(pointer, size);
+}
+
+
+// Prints counters when the program ends.
+__attribute__((destructor)) static void report(){
+    dprintf(STDERR_FILENO, "ALLOCATIONS: malloc %llu, realloc %llu\n", allocations, reallocations);
+}
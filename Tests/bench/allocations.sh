@@ -0,0 +1,27 @@
+#!/bin/bash
+# Heap allocations of ppcbc sending messages of different sizes.
+# Number of allocations shouldn't depend on the number of packages.
+# Usage: allocations.sh [port]
+
+PORT=${1:-9001}
+ROOT=$(dirname "$0")/../..
+
+make -C "$ROOT" > /dev/null || exit 1
+gcc -O2 -shared -fPIC "$(dirname "$0")/alloc_count.c" -o /tmp/alloc_count.so || exit 1
+
+for protocol in tcp udp udpr; do
+    server=$protocol
+    if [ "$protocol" = udpr ]; then
+        server=udp
+    fi
+    "$ROOT/ppcbs" "$server" "$PORT" > /dev/null 2>&1 &
+    SERVER=$!
+    sleep 0.5
+    for size in 1 10 100; do
+        head -c $((size * 1000 * 1000)) /dev/zero | tr '\0' 'a' > /tmp/alloc_input
+        echo "$protocol ${size}MB $(LD_PRELOAD=/tmp/alloc_count.so "$ROOT/ppcbc" "$protocol" 127.0.0.1 "$PORT" < /tmp/alloc_input 2>&1 | grep ALLOCATIONS)"
+    done
+    kill "$SERVER"
+    wait "$SERVER" 2> /dev/null || true
+done
+rm -f /tmp/alloc_input
@@ -0,0 +1,37 @@
+#!/bin/bash
+# CPU time used by ppcbs to receive one GB into a file, measured from /proc.
+# Usage: [OUTPUT=pipe] cpu_per_gb.sh <client protocol> [MB] [port] [ppcbs options...]
+
+PROTOCOL=${1:-udpr}
+SIZE=${2:-1000}
+PORT=${3:-9002}
+ROOT=$(dirname "$0")/../..
+SERVER_PROTOCOL=udp
+if [ "$PROTOCOL" = tcp ]; then
+    SERVER_PROTOCOL=tcp
+fi
+
+make -C "$ROOT" > /dev/null || exit 1
+head -c $((SIZE * 1000 * 1000)) /dev/zero | tr '\0' 'a' > /tmp/cpu_input
+
+if [ "$OUTPUT" = pipe ]; then  # Output read by another process.
+    "$ROOT/ppcbs" "$SERVER_PROTOCOL" "$PORT" "${@:4}" > >(cat > /dev/null) &
+else
+    "$ROOT/ppcbs" "$SERVER_PROTOCOL" "$PORT" "${@:4}" > /tmp/cpu_output &
+fi
+SERVER=$!
+sleep 0.5
+START=$(date +%s.%N)
+"$ROOT/ppcbc" "$PROTOCOL" 127.0.0.1 "$PORT" < /tmp/cpu_input
+END=$(date +%s.%N)
+# Fields 14 and 15 of stat are user and system time in clock ticks.
+read -r USER SYSTEM < <(awk '{print $14, $15}' "/proc/$SERVER/stat")
+kill "$SERVER"
+wait "$SERVER" 2> /dev/null || true
+rm -f /tmp/cpu_input /tmp/cpu_output
+
+TICKS=$(getconf CLK_TCK)
+awk -v user="$USER" -v kernel="$SYSTEM" -v ticks="$TICKS" -v size="$SIZE" -v start="$START" -v end="$END" 'BEGIN {
+    printf "user %.3f s/GB, system %.3f s/GB, wall %.3f s/GB\n",
+           user / ticks * 1000 / size, kernel / ticks * 1000 / size, (end - start) * 1000 / size
+}'
@@ -0,0 +1,43 @@
+#!/bin/bash
+# Time to send a message with --negotiate to a server which doesn't know capabilities and to the current one.
+# The client tries again without capabilities when the old server drops or closes its CONN.
+# Usage: fallback.sh [KB] [port]
+
+SIZE=${1:-500}
+PORT=${2:-9010}
+ROOT=$(dirname "$0")/../..
+
+make -C "$ROOT" > /dev/null || exit 1
+gcc -Wall -Wextra -O2 -std=gnu17 -o /tmp/fallback_serv "$ROOT/Tests/test_servers/old_serv.c" || exit 1
+head -c $((SIZE * 1000)) /dev/urandom > /tmp/fallback_input
+
+echo "server protocol seconds"
+for SERVER_KIND in old current; do
+    for PROTOCOL in udp udpr tcp; do
+        SERVER_PROTOCOL=udp
+        if [ "$PROTOCOL" = tcp ]; then
+            SERVER_PROTOCOL=tcp
+        fi
+        SERVER_BINARY="$ROOT/ppcbs"
+        if [ "$SERVER_KIND" = old ]; then
+            SERVER_BINARY=/tmp/fallback_serv
+        fi
+        "$SERVER_BINARY" "$SERVER_PROTOCOL" "$PORT" > /tmp/fallback_output 2> /dev/null &
+        SERVER=$!
+        sleep 0.5
+        START=$(date +%s.%N)
+        if ! "$ROOT/ppcbc" "$PROTOCOL" 127.0.0.1 "$PORT" --negotiate --timeout 2000 < /tmp/fallback_input 2> /dev/null; then
+            echo "ERROR: Client failed with $SERVER_KIND server over $PROTOCOL." >&2
+        fi
+        END=$(date +%s.%N)
+        sleep 0.2
+        kill "$SERVER"
+        wait "$SERVER" 2> /dev/null
+        if ! cmp -s /tmp/fallback_input /tmp/fallback_output; then
+            echo "ERROR: $SERVER_KIND server wrote different data over $PROTOCOL." >&2
+        fi
+        awk -v server="$SERVER_KIND" -v protocol="$PROTOCOL" -v start="$START" -v end="$END" \
+            'BEGIN {printf "%s %s %.2f\n", server, protocol, end - start}'
+    done
+done
+rm -f /tmp/fallback_serv /tmp/fallback_input /tmp/fallback_output
@@ -0,0 +1,52 @@
+#!/bin/bash
+# Success rate and goodput of plain UDP transfers with and without FEC, against loss of client datagrams.
+# Usage: fec_loss.sh [MB] [runs] [port] [loss percents...]
+
+SIZE=${1:-10}
+RUNS=${2:-20}
+PORT=${3:-9004}
+LOSSES=("${@:4}")
+if [ ${#LOSSES[@]} -eq 0 ]; then
+    LOSSES=(0 0.1 0.5 1 2 5)
+fi
+ROOT=$(dirname "$0")/../..
+
+make -C "$ROOT" > /dev/null || exit 1
+gcc -O2 -Wall -Wextra "$(dirname "$0")/lossy_relay.c" -o /tmp/lossy_relay || exit 1
+head -c $((SIZE * 1000 * 1000)) /dev/urandom > /tmp/fec_input
+
+"$ROOT/ppcbs" udp "$PORT" > /tmp/fec_output 2> /dev/null &
+SERVER=$!
+sleep 0.5
+
+echo "loss% mode success goodput_MB/s"
+for LOSS in "${LOSSES[@]}"; do
+    for MODE in plain fec; do
+        OPTIONS=()
+        if [ "$MODE" = fec ]; then
+            OPTIONS=(--fec)
+        fi
+        /tmp/lossy_relay $((PORT + 1)) 127.0.0.1 "$PORT" "$LOSS" "$RANDOM" 2> /dev/null &
+        RELAY=$!
+        sleep 0.2
+        SUCCESS=0
+        TIME=0
+        for ((run = 0; run < RUNS; run++)); do
+            START=$(date +%s%N)
+            # Batches are spaced, so only the relay loses datagrams.
+            if "$ROOT/ppcbc" udp 127.0.0.1 $((PORT + 1)) --batch 8 --gap 200 "${OPTIONS[@]}" < /tmp/fec_input 2> /dev/null; then
+                SUCCESS=$((SUCCESS + 1))
+                TIME=$((TIME + $(date +%s%N) - START))
+            fi
+            sleep 0.1
+        done
+        kill "$RELAY"
+        wait "$RELAY" 2> /dev/null
+        awk -v loss="$LOSS" -v mode="$MODE" -v ok="$SUCCESS" -v runs="$RUNS" -v time="$TIME" -v size="$SIZE" 'BEGIN {
+            printf "%s %s %.0f%% %.1f\n", loss, mode, ok * 100 / runs, (ok > 0 ? size * ok / (time / 1e9) : 0)
+        }'
+    done
+done
+kill "$SERVER"
+wait "$SERVER" 2> /dev/null || true
+rm -f /tmp/fec_input /tmp/fec_output
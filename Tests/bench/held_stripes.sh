@@ -0,0 +1,42 @@
+#!/bin/bash
+# Striped transfer whose ranges are larger than the buffers the server holds per stripe. Stripes behind
+# the head fill their buffers and wait for it, paced by '--rate' longer than the client's timeout.
+# Usage: held_stripes.sh [MB] [streams] [MB/s] [port]
+
+SIZE=${1:-80}
+STREAMS=${2:-2}
+RATE=${3:-2}
+PORT=${4:-9010}
+ROOT=$(dirname "$0")/../..
+HELD=$((256 * 64000))  # STRIPE_BUFFERS buffers of BUFFOR_SIZE bytes.
+
+make -C "$ROOT" > /dev/null || exit 1
+if [ $((SIZE * 1000 * 1000 / STREAMS)) -le "$HELD" ]; then
+    echo "ERROR: Ranges fit the buffers of a stripe." >&2
+    exit 1
+fi
+head -c $((SIZE * 1000 * 1000)) /dev/urandom > /tmp/held_input
+
+echo "protocol seconds"
+for PROTOCOL in udpr udpw udpn tcp; do
+    SERVER_PROTOCOL=udp
+    if [ "$PROTOCOL" = tcp ]; then
+        SERVER_PROTOCOL=tcp
+    fi
+    "$ROOT/ppcbs" "$SERVER_PROTOCOL" "$PORT" > /tmp/held_output &
+    SERVER=$!
+    sleep 0.5
+    START=$(date +%s.%N)
+    if ! "$ROOT/ppcbc" "$PROTOCOL" 127.0.0.1 "$PORT" --streams "$STREAMS" --rate "$RATE" < /tmp/held_input; then
+        echo "ERROR: $PROTOCOL client failed." >&2
+    fi
+    END=$(date +%s.%N)
+    kill "$SERVER"
+    wait "$SERVER" 2> /dev/null
+    if ! cmp -s /tmp/held_input /tmp/held_output; then
+        echo "ERROR: Server wrote different data over $PROTOCOL." >&2
+    fi
+    awk -v protocol="$PROTOCOL" -v start="$START" -v end="$END" 'BEGIN {printf "%s %.2f\n", protocol, end - start}'
+    PORT=$((PORT + 1))  # TCP port may linger in TIME_WAIT.
+done
+rm -f /tmp/held_input /tmp/held_output
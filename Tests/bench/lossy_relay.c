@@ -0,0 +1,80 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+
+// Max size of a datagram.
+#define MAX_DATAGRAM 65536
+
+
+// Forwards datagrams between clients and the server, dropping given percent of those sent by clients.
+// Answers of the server go to the client which sent the last datagram.
+int main(int argc, char *argv[]){
+    if (argc != 5 && argc != 6){
+        fprintf(stderr, "ERROR: Expected arguments: %s <port> <server host> <server port> <loss percent> [seed]\n", argv[0]);
+        return 1;
+    }
+    struct sockaddr_in local = {.sin_family = AF_INET, .sin_port = htons(atoi(argv[1])), .sin_addr.s_addr = htonl(INADDR_ANY)};
+    struct sockaddr_in server = {.sin_family = AF_INET, .sin_port = htons(atoi(argv[3]))};
+    if (inet_pton(AF_INET, argv[2], &server.sin_addr) != 1){
+        fprintf(stderr, "ERROR: %s is not an IPv4 address.\n", argv[2]);
+        return 1;
+    }
+    double loss = atof(argv[4]) / 100;
+    srand48(argc == 6 ? atol(argv[5]) : 1);
+
+    int client_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    int server_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    int size = 8 * 1024 * 1024;  // Bursts of the client aren't dropped by the relay itself.
+    setsockopt(client_fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    setsockopt(server_fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    if (bind(client_fd, (struct sockaddr *) &local, sizeof(local)) < 0 ||
+        connect(server_fd, (struct sockaddr *) &server, sizeof(server)) < 0){
+        fprintf(stderr, "ERROR: Couldn't set up sockets.\n");
+        return 1;
+    }
+
+    static char buff[MAX_DATAGRAM];
+    struct sockaddr_in client;
+    socklen_t client_length = 0;
+    struct pollfd fds[2] = {{.fd = client_fd, .events = POLLIN}, {.fd = server_fd, .events = POLLIN}};
+    unsigned long long forwarded = 0, dropped = 0;
+    for (;;){
+        if (poll(fds, 2, -1) < 0){
+            if (errno == EINTR){
+                continue;
+            }
+            break;
+        }
+        if (fds[0].revents & POLLIN){  // From a client.
+            socklen_t length = sizeof(client);
+            ssize_t received = recvfrom(client_fd, buff, sizeof(buff), 0, (struct sockaddr *) &client, &length);
+            if (received >= 0){
+                client_length = length;
+                if (drand48() < loss){
+                    dropped++;
+                }
+                else{
+                    send(server_fd, buff, received, 0);
+                    forwarded++;
+                }
+            }
+        }
+        if (fds[1].revents & POLLIN){  // From the server.
+            ssize_t received = recv(server_fd, buff, sizeof(buff), 0);
+            if (received >= 0 && client_length > 0){
+                sendto(client_fd, buff, received, 0, (struct sockaddr *) &client, client_length);
+            }
+        }
+    }
+    fprintf(stderr, "%llu forwarded, %llu dropped\n", forwarded, dropped);
+    return 0;
+}
@@ -0,0 +1,51 @@
+#!/bin/bash
+# Records of different sizes sent in one session, each message has to be confirmed by DONE before RCVD
+# and the server has to write the same records it was given.
+# Usage: messages.sh [port]
+
+PORT=${1:-9011}
+ROOT=$(dirname "$0")/../..
+SIZES=(0 1 200 64000 100000 3 0 70000)
+
+make -C "$ROOT" > /dev/null || exit 1
+: > /tmp/messages_input
+for SIZE in "${SIZES[@]}"; do  # Record is 4 byte big endian length followed by data.
+    printf "$(printf '\\x%02x\\x%02x\\x%02x\\x%02x' $((SIZE >> 24 & 255)) $((SIZE >> 16 & 255)) $((SIZE >> 8 & 255)) $((SIZE & 255)))" \
+        >> /tmp/messages_input
+    head -c "$SIZE" /dev/urandom >> /tmp/messages_input
+done
+
+echo "protocol messages confirmed"
+for PROTOCOL in tcp udp udpr udpw udpn; do
+    SERVER_PROTOCOL=udp
+    if [ "$PROTOCOL" = tcp ]; then
+        SERVER_PROTOCOL=tcp
+    fi
+    "$ROOT/ppcbs" "$SERVER_PROTOCOL" "$PORT" > /tmp/messages_output &
+    SERVER=$!
+    sleep 0.5
+    "$ROOT/ppcbc" "$PROTOCOL" 127.0.0.1 "$PORT" --session --stats < /tmp/messages_input 2> /tmp/messages_stats
+    sleep 0.2
+    kill "$SERVER"
+    wait "$SERVER" 2> /dev/null
+    read -r SENT CONFIRMED < <(awk '/messages,/ {print $2, $4}' /tmp/messages_stats)
+    if [ "$SENT" != "${#SIZES[@]}" ] || [ "$CONFIRMED" != "${#SIZES[@]}" ]; then
+        echo "ERROR: $PROTOCOL confirmed ${CONFIRMED:-no} of ${#SIZES[@]} messages." >&2
+    fi
+    if ! cmp -s /tmp/messages_input /tmp/messages_output; then
+        echo "ERROR: Server wrote different records over $PROTOCOL." >&2
+    fi
+    echo "$PROTOCOL ${SENT:-0} ${CONFIRMED:-0}"
+done
+
+# Input ending inside a record is refused by the client.
+head -c 10 /tmp/messages_input | tail -c 6 > /tmp/messages_broken
+"$ROOT/ppcbs" udp "$PORT" > /dev/null 2>&1 &
+SERVER=$!
+sleep 0.5
+if "$ROOT/ppcbc" udpr 127.0.0.1 "$PORT" --session < /tmp/messages_broken 2> /dev/null; then
+    echo "ERROR: Client sent input which ends inside a message." >&2
+fi
+kill "$SERVER"
+wait "$SERVER" 2> /dev/null
+rm -f /tmp/messages_input /tmp/messages_output /tmp/messages_stats /tmp/messages_broken
@@ -0,0 +1,42 @@
+#!/bin/bash
+# Datagrams per second and CPU time per GB of client and server, with and without GSO/GRO,
+# for MTU-sized packages over loopback.
+# Usage: offload.sh [client protocol] [MB] [size] [port]
+
+PROTOCOL=${1:-udp}
+SIZE=${2:-1000}
+PACKAGE=${3:-1400}
+PORT=${4:-9005}
+ROOT=$(dirname "$0")/../..
+
+make -C "$ROOT" > /dev/null || exit 1
+head -c $((SIZE * 1000 * 1000)) /dev/zero | tr '\0' 'a' > /tmp/offload_input
+TICKS=$(getconf CLK_TCK)
+TIMEFORMAT='%U %S %R'
+
+echo "mode datagrams/s client_user client_system server_user server_system (s/GB)"
+for MODE in offload plain; do
+    SERVER_OPTIONS=()
+    CLIENT_OPTIONS=(--size "$PACKAGE" --stats)
+    if [ "$MODE" = plain ]; then
+        SERVER_OPTIONS=(--no-gro)
+        CLIENT_OPTIONS+=(--no-gso)
+    fi
+    "$ROOT/ppcbs" udp "$PORT" "${SERVER_OPTIONS[@]}" > /dev/null &
+    SERVER=$!
+    sleep 0.5
+    # Client statistics and its CPU time both go to stderr.
+    CLIENT=$( { time "$ROOT/ppcbc" "$PROTOCOL" 127.0.0.1 "$PORT" "${CLIENT_OPTIONS[@]}" < /tmp/offload_input; } 2>&1 )
+    # Fields 14 and 15 of stat are user and system time in clock ticks.
+    read -r USER SYSTEM < <(awk '{print $14, $15}' "/proc/$SERVER/stat")
+    kill "$SERVER"
+    wait "$SERVER" 2> /dev/null || true
+    PACKAGES=$(echo "$CLIENT" | awk '/^STATS/ {print $2}')
+    read -r CLIENT_USER CLIENT_SYSTEM WALL < <(echo "$CLIENT" | tail -n 1)
+    awk -v mode="$MODE" -v packages="$PACKAGES" -v wall="$WALL" -v cuser="$CLIENT_USER" -v csystem="$CLIENT_SYSTEM" \
+        -v user="$USER" -v kernel="$SYSTEM" -v ticks="$TICKS" -v size="$SIZE" 'BEGIN {
+        printf "%s %.0f %.3f %.3f %.3f %.3f\n", mode, packages / wall, cuser * 1000 / size, csystem * 1000 / size,
+               user / ticks * 1000 / size, kernel / ticks * 1000 / size
+    }'
+done
+rm -f /tmp/offload_input
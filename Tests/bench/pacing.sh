@@ -0,0 +1,44 @@
+#!/bin/bash
+# Pacing rates from the trace of the client: plain UDP gets no congestion window, so it is paced only
+# by '--rate', while windowed and NACK senders are paced by their window.
+# Usage: pacing.sh [MB] [MB/s] [port]
+
+SIZE=${1:-5}
+RATE=${2:-100}
+PORT=${3:-9009}
+ROOT=$(dirname "$0")/../..
+
+make -C "$ROOT" > /dev/null || exit 1
+head -c $((SIZE * 1000 * 1000)) /dev/urandom > /tmp/pacing_input
+
+echo "protocol limit rates seconds"
+for PROTOCOL in udp udpw udpn; do
+    for LIMIT in none "$RATE"; do
+        CLIENT_OPTIONS=(--trace /tmp/pacing_trace)
+        EXPECTED=0
+        if [ "$LIMIT" != none ]; then
+            CLIENT_OPTIONS+=(--rate "$LIMIT")
+            EXPECTED=$((LIMIT * 1000 * 1000))
+        fi
+        "$ROOT/ppcbs" udp "$PORT" > /tmp/pacing_output &
+        SERVER=$!
+        sleep 0.5
+        START=$(date +%s.%N)
+        "$ROOT/ppcbc" "$PROTOCOL" 127.0.0.1 "$PORT" "${CLIENT_OPTIONS[@]}" < /tmp/pacing_input || exit 1
+        END=$(date +%s.%N)
+        sleep 0.2
+        kill "$SERVER"
+        wait "$SERVER" 2> /dev/null
+        # Last field of every trace line is the pacing rate (bytes/s).
+        RATES=$(awk '!/^#/ {print $NF}' /tmp/pacing_trace | sort -u | tr '\n' ' ')
+        if [ "$PROTOCOL" = udp ] && [ "$RATES" != "$EXPECTED " ]; then
+            echo "ERROR: Plain UDP is paced by congestion window." >&2
+        fi
+        if [ "$PROTOCOL" = udp ] && ! cmp -s /tmp/pacing_input /tmp/pacing_output; then
+            echo "ERROR: Server wrote different data." >&2
+        fi
+        awk -v protocol="$PROTOCOL" -v limit="$LIMIT" -v rates="$(echo "$RATES" | wc -w)" -v start="$START" -v end="$END" \
+            'BEGIN {printf "%s %s %d %.2f\n", protocol, limit, rates, end - start}'
+    done
+done
+rm -f /tmp/pacing_input /tmp/pacing_output /tmp/pacing_trace
@@ -0,0 +1,49 @@
+#!/bin/bash
+# Time of a retry after the client was killed partway through, starting anew compared with resuming.
+# Usage: resume.sh <client protocol> [MB] [seconds before kill] [port]
+
+PROTOCOL=${1:-udpr}
+SIZE=${2:-300}
+KILL=${3:-0.3}
+PORT=${4:-9008}
+ROOT=$(dirname "$0")/../..
+SERVER_PROTOCOL=udp
+WAIT=11  # Server gives up on silent UDPR client after all its retransmissions.
+if [ "$PROTOCOL" = tcp ]; then
+    SERVER_PROTOCOL=tcp
+    WAIT=1
+elif [ "$PROTOCOL" = udp ]; then
+    WAIT=2
+fi
+
+make -C "$ROOT" > /dev/null || exit 1
+head -c $((SIZE * 1000 * 1000)) /dev/urandom > /tmp/resume_input
+rm -rf /tmp/resume_records
+mkdir /tmp/resume_records
+
+echo "mode retry_s sent_MB"
+for MODE in anew resumed; do
+    CLIENT_OPTIONS=(--stats)
+    if [ "$MODE" = resumed ]; then
+        CLIENT_OPTIONS+=(--resume 1)
+    fi
+    "$ROOT/ppcbs" "$SERVER_PROTOCOL" "$PORT" --checkpoints /tmp/resume_records > /tmp/resume_output &
+    SERVER=$!
+    sleep 0.5
+    timeout -s KILL "$KILL" "$ROOT/ppcbc" "$PROTOCOL" 127.0.0.1 "$PORT" "${CLIENT_OPTIONS[@]}" < /tmp/resume_input 2> /dev/null
+    sleep "$WAIT"  # Session of the killed client ends, its progress is recorded.
+    START=$(date +%s.%N)
+    "$ROOT/ppcbc" "$PROTOCOL" 127.0.0.1 "$PORT" "${CLIENT_OPTIONS[@]}" < /tmp/resume_input 2> /tmp/resume_stats || exit 1
+    END=$(date +%s.%N)
+    kill "$SERVER"
+    wait "$SERVER" 2> /dev/null
+    SENT=$((SIZE * 1000 * 1000))
+    if [ "$MODE" = resumed ]; then
+        SENT=$(awk '/bytes written before/ {print $6}' /tmp/resume_stats)
+        if ! cmp -s /tmp/resume_input /tmp/resume_output; then
+            echo "ERROR: Server wrote different data after resuming." >&2
+        fi
+    fi
+    awk -v mode="$MODE" -v sent="$SENT" -v start="$START" -v end="$END" 'BEGIN {printf "%s %.2f %.1f\n", mode, end - start, sent / 1e6}'
+done
+rm -rf /tmp/resume_input /tmp/resume_output /tmp/resume_records /tmp/resume_stats
@@ -0,0 +1,47 @@
+#!/bin/bash
+# Messages per second when every small message is sent by its own ppcbc, compared with one session carrying all of them.
+# Usage: sessions.sh <client protocol> [messages] [message size] [port]
+
+PROTOCOL=${1:-tcp}
+COUNT=${2:-1000}
+MESSAGE=${3:-200}
+PORT=${4:-9006}
+ROOT=$(dirname "$0")/../..
+SERVER_PROTOCOL=udp
+if [ "$PROTOCOL" = tcp ]; then
+    SERVER_PROTOCOL=tcp
+fi
+
+make -C "$ROOT" > /dev/null || exit 1
+head -c "$MESSAGE" /dev/zero | tr '\0' 'a' > /tmp/sessions_message
+# Session reads records, each 4 byte big endian length followed by the message.
+printf "$(printf '\\x%02x\\x%02x\\x%02x\\x%02x' $((MESSAGE >> 24 & 255)) $((MESSAGE >> 16 & 255)) $((MESSAGE >> 8 & 255)) $((MESSAGE & 255)))" \
+    > /tmp/sessions_record
+cat /tmp/sessions_message >> /tmp/sessions_record
+for ((i = 0; i < COUNT; i++)); do
+    cat /tmp/sessions_record
+done > /tmp/sessions_input
+
+"$ROOT/ppcbs" "$SERVER_PROTOCOL" "$PORT" > /tmp/sessions_output &
+SERVER=$!
+sleep 0.5
+
+echo "mode messages/s"
+START=$(date +%s.%N)
+for ((i = 0; i < COUNT; i++)); do  # Process, socket and handshake for every message.
+    "$ROOT/ppcbc" "$PROTOCOL" 127.0.0.1 "$PORT" < /tmp/sessions_message || exit 1
+done
+END=$(date +%s.%N)
+awk -v count="$COUNT" -v start="$START" -v end="$END" 'BEGIN {printf "separate %.0f\n", count / (end - start)}'
+
+START=$(date +%s.%N)
+"$ROOT/ppcbc" "$PROTOCOL" 127.0.0.1 "$PORT" --session < /tmp/sessions_input || exit 1
+END=$(date +%s.%N)
+awk -v count="$COUNT" -v start="$START" -v end="$END" 'BEGIN {printf "session %.0f\n", count / (end - start)}'
+
+kill "$SERVER"
+wait "$SERVER" 2> /dev/null || true
+if [ "$(stat -c %s /tmp/sessions_output)" != $((COUNT * (2 * MESSAGE + 4))) ]; then  # Records are written with their headers.
+    echo "ERROR: Server wrote wrong number of bytes." >&2
+fi
+rm -f /tmp/sessions_message /tmp/sessions_record /tmp/sessions_input /tmp/sessions_output
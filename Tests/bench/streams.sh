@@ -0,0 +1,39 @@
+#!/bin/bash
+# Throughput of one message striped over 1, 2, 4, ... parallel connections, up to the given number.
+# With a delay, loopback is slowed down by netem (needs root), so every flow is limited by its round trips.
+# Usage: streams.sh <client protocol> [MB] [max streams] [delay ms] [port]
+
+PROTOCOL=${1:-udpr}
+SIZE=${2:-20}
+MAX=${3:-8}
+DELAY=${4:-0}
+PORT=${5:-9007}
+ROOT=$(dirname "$0")/../..
+SERVER_PROTOCOL=udp
+if [ "$PROTOCOL" = tcp ]; then
+    SERVER_PROTOCOL=tcp
+fi
+
+make -C "$ROOT" > /dev/null || exit 1
+head -c $((SIZE * 1000 * 1000)) /dev/urandom > /tmp/streams_input
+if [ "$DELAY" != 0 ]; then
+    tc qdisc add dev lo root netem delay "${DELAY}ms" || exit 1
+    trap 'tc qdisc del dev lo root' EXIT
+fi
+
+echo "streams MB/s"
+for ((STREAMS = 1; STREAMS <= MAX; STREAMS *= 2)); do
+    "$ROOT/ppcbs" "$SERVER_PROTOCOL" "$PORT" > /tmp/streams_output &
+    SERVER=$!
+    sleep 0.5
+    START=$(date +%s.%N)
+    "$ROOT/ppcbc" "$PROTOCOL" 127.0.0.1 "$PORT" --streams "$STREAMS" < /tmp/streams_input || exit 1
+    END=$(date +%s.%N)
+    kill "$SERVER"
+    wait "$SERVER" 2> /dev/null
+    if ! cmp -s /tmp/streams_input /tmp/streams_output; then
+        echo "ERROR: Server wrote different data with $STREAMS streams." >&2
+    fi
+    awk -v streams="$STREAMS" -v size="$SIZE" -v start="$START" -v end="$END" 'BEGIN {printf "%d %.1f\n", streams, size / (end - start)}'
+done
+rm -f /tmp/streams_input /tmp/streams_output
@@ -0,0 +1,166 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/random.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+
+// Max payload of DATA package.
+#define MAX_MSG 64000
+
+
+// Settings shared by sender threads.
+typedef struct flood{
+    struct sockaddr_in server;
+    unsigned int sessions;
+    unsigned int payload;
+    double seconds;
+} flood;
+
+
+// Sender thread state.
+typedef struct sender{
+    pthread_t thread;
+    flood *settings;
+    unsigned long long acked;  // DATA packages confirmed by the server.
+} sender;
+
+
+// Current monotonic time in seconds.
+double now(){
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+
+// Sends CONN (UDPR) of session with given ID.
+void send_conn(int socket_fd, struct sockaddr_in *server, unsigned char *sess){
+    unsigned char pack[1 + 8 + 1 + 8];
+    uint64_t length = htobe64(UINT64_MAX / 2);  // Never ends.
+    pack[0] = 1;
+    memcpy(pack + 1, sess, 8);
+    pack[9] = 3;
+    memcpy(pack + 10, &length, 8);
+    sendto(socket_fd, pack, sizeof(pack), 0, (struct sockaddr *) server, sizeof(*server));
+}
+
+
+// Sends DATA with given ID of session with given ID.
+void send_data(int socket_fd, struct sockaddr_in *server, unsigned char *sess, uint64_t pack_id, unsigned char *pack, unsigned int payload){
+    uint64_t id = htobe64(pack_id);
+    uint32_t len = htobe32(payload);
+    pack[0] = 4;
+    memcpy(pack + 1, sess, 8);
+    memcpy(pack + 9, &id, 8);
+    memcpy(pack + 17, &len, 4);
+    sendto(socket_fd, pack, 21 + payload, 0, (struct sockaddr *) server, sizeof(*server));
+}
+
+
+// Keeps one DATA of every session in flight, counts ACCs.
+void *sender_main(void *arg){
+    sender *me = arg;
+    flood *settings = me->settings;
+    int socket_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    struct timeval timeout = {.tv_sec = 0, .tv_usec = 100000};
+    setsockopt(socket_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    // Session IDs: random first four bytes spread sessions between workers, last four are indexes.
+    unsigned char (*sess)[8] = malloc(settings->sessions * 8);
+    uint64_t *next = calloc(settings->sessions, sizeof(uint64_t));  // Next DATA ID of the session.
+    bool *accepted = calloc(settings->sessions, sizeof(bool));
+    unsigned char *pack = calloc(1, 21 + settings->payload);
+    for (uint32_t i = 0; i < settings->sessions; i++){
+        getrandom(sess[i], 4, 0);
+        memcpy(sess[i] + 4, &i, 4);
+        send_conn(socket_fd, &settings->server, sess[i]);
+    }
+
+    double end = now() + settings->seconds;
+    unsigned char back[32];
+    while (now() < end){
+        ssize_t received = recv(socket_fd, back, sizeof(back), 0);
+        if (received < 0){  // Lost package, restarting every session.
+            for (uint32_t i = 0; i < settings->sessions; i++){
+                if (accepted[i]){
+                    send_data(socket_fd, &settings->server, sess[i], next[i], pack, settings->payload);
+                }
+                else{
+                    send_conn(socket_fd, &settings->server, sess[i]);
+                }
+            }
+            continue;
+        }
+        uint32_t i;
+        memcpy(&i, back + 5, 4);
+        if (received < 9 || i >= settings->sessions){
+            continue;
+        }
+        if (back[0] == 2 && !accepted[i]){  // CONACC.
+            accepted[i] = true;
+            send_data(socket_fd, &settings->server, sess[i], next[i], pack, settings->payload);
+        }
+        else if (back[0] == 5 && received >= 17){  // ACC.
+            uint64_t acked;
+            memcpy(&acked, back + 9, 8);
+            if (be64toh(acked) == next[i]){
+                me->acked++;
+                next[i]++;
+                send_data(socket_fd, &settings->server, sess[i], next[i], pack, settings->payload);
+            }
+        }
+    }
+    free(sess);
+    free(next);
+    free(accepted);
+    free(pack);
+    close(socket_fd);
+    return NULL;
+}
+
+
+// Measures how many UDPR DATA packages per second the server confirms.
+int main(int argc, char *argv[]){
+    if (argc != 7){
+        fprintf(stderr, "ERROR: Expected arguments: %s <host> <port> <threads> <sessions per thread> <payload> <seconds>\n", argv[0]);
+        return 1;
+    }
+    flood settings;
+    settings.server.sin_family = AF_INET;
+    settings.server.sin_port = htons(atoi(argv[2]));
+    if (inet_pton(AF_INET, argv[1], &settings.server.sin_addr) != 1){
+        fprintf(stderr, "ERROR: %s is not an IPv4 address.\n", argv[1]);
+        return 1;
+    }
+    int threads = atoi(argv[3]);
+    settings.sessions = atoi(argv[4]);
+    settings.payload = atoi(argv[5]);
+    settings.seconds = atof(argv[6]);
+    if (threads <= 0 || settings.sessions == 0 || settings.payload == 0 || settings.payload > MAX_MSG){
+        fprintf(stderr, "ERROR: Wrong arguments.\n");
+        return 1;
+    }
+
+    sender *senders = calloc(threads, sizeof(sender));
+    for (int i = 0; i < threads; i++){
+        senders[i].settings = &settings;
+        pthread_create(&senders[i].thread, NULL, sender_main, &senders[i]);
+    }
+    unsigned long long acked = 0;
+    for (int i = 0; i < threads; i++){
+        pthread_join(senders[i].thread, NULL);
+        acked += senders[i].acked;
+    }
+    printf("%.0f\n", acked / settings.seconds);
+    free(senders);
+    return 0;
+}
@@ -0,0 +1,22 @@
+#!/bin/bash
+# Packages per second confirmed by UDP server for 1 to N workers.
+# Usage: workers.sh <max workers> [port] [payload] [seconds]
+
+MAX=${1:-4}
+PORT=${2:-9000}
+PAYLOAD=${3:-64}
+SECONDS_RUN=${4:-5}
+ROOT=$(dirname "$0")/../..
+
+make -C "$ROOT" ppcbs > /dev/null || exit 1
+gcc -O2 -Wall -Wextra -pthread "$(dirname "$0")/udp_flood.c" -o /tmp/udp_flood || exit 1
+
+echo "workers packages/s"
+for ((workers = 1; workers <= MAX; workers++)); do
+    "$ROOT/ppcbs" udp "$PORT" --workers "$workers" > /dev/null 2>&1 &
+    SERVER=$!
+    sleep 0.5
+    echo "$workers $(/tmp/udp_flood 127.0.0.1 "$PORT" "$MAX" 64 "$PAYLOAD" "$SECONDS_RUN")"
+    kill "$SERVER"
+    wait "$SERVER" 2> /dev/null || true
+done
@@ -0,0 +1,235 @@
+// Server from before capabilities were negotiated, serving one client at a time.
+// CONN with flags it doesn't know is dropped over UDP and closes the connection over TCP,
+// so clients offering capabilities have to try again without them.
+// Usage: old_serv <tcp|udp> <port>
+#include <sys/socket.h>
+#include <errno.h>
+#include <endian.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <stdbool.h>
+
+#define MAX_MSG 64000
+#define MAX_WAIT 10
+
+// Conn package components.
+typedef struct __attribute__ ((__packed__)) conn{
+    uint64_t session_id;
+    uint8_t protocol;
+    uint64_t length;
+} conn;
+
+// Base package components.
+typedef struct __attribute__ ((__packed__)) base{
+    uint64_t session_id;
+} base;
+
+// Data package components.
+typedef struct __attribute__ ((__packed__)) data_msg{
+    uint64_t session_id;
+    uint64_t pack_id;
+    uint32_t byte_len;
+} data_msg;
+
+// Data packages status components.
+typedef struct __attribute__ ((__packed__)) status{
+    uint64_t session_id;
+    uint64_t pack_id;
+} status;
+
+
+// Creates port.
+static uint16_t read_port(char const *string, bool *error){
+    char *endptr;
+    unsigned long port = strtoul(string, &endptr, 10);
+    if ((port == ULONG_MAX && errno == ERANGE) || *endptr != 0 || port == 0 || port > UINT16_MAX){
+        fprintf(stderr, "ERROR: %s is not a valid port number.\n", string);
+        *error = true;
+    }
+    return (uint16_t) port;
+}
+
+
+// Sends package 'id' followed by 'len' bytes of 'pack' to the client.
+int send_pack(int socket_fd, uint8_t id, void const *pack, size_t len, struct sockaddr_in const *address){
+    char buff[sizeof(uint8_t) + sizeof(status)];
+    buff[0] = id;
+    memcpy(buff + sizeof(uint8_t), pack, len);
+    ssize_t sent = address != NULL ? sendto(socket_fd, buff, sizeof(uint8_t) + len, 0, (struct sockaddr const *) address, sizeof(*address))
+                                   : write(socket_fd, buff, sizeof(uint8_t) + len);
+    if (sent != (ssize_t) (sizeof(uint8_t) + len)){
+        fprintf(stderr, "ERROR: Couldn't send message.\n");
+        return 1;
+    }
+    return 0;
+}
+
+
+// Sends status package 'id' about package 'pack_id' of session 'sess_id'.
+int send_status(int socket_fd, uint8_t id, uint64_t sess_id, uint64_t pack_id, struct sockaddr_in const *address){
+    status pack = {.session_id = sess_id, .pack_id = htobe64(pack_id)};
+    return send_pack(socket_fd, id, &pack, sizeof(status), address);
+}
+
+
+// Reads exactly 'size' bytes.
+int tcp_read(int socket_fd, void *data, size_t size){
+    size_t done = 0;
+    while (done < size){
+        ssize_t got = read(socket_fd, (char *) data + done, size - done);
+        if (got <= 0){
+            fprintf(stderr, "ERROR: Couldn't read message.\n");
+            return 1;
+        }
+        done += got;
+    }
+    return 0;
+}
+
+
+// Receives one message from a TCP client.
+void tcp_client(int client_fd){
+    static char buff[MAX_MSG];
+    uint8_t id;
+    conn received;
+    if (tcp_read(client_fd, &id, sizeof(uint8_t)) == 1 || tcp_read(client_fd, &received, sizeof(conn)) == 1){
+        return;
+    }
+    if (id != 1 || received.protocol != 1){  // Flags weren't known yet.
+        fprintf(stderr, "ERROR: Wrong protocol.\n");
+        return;
+    }
+    base answer = {.session_id = received.session_id};
+    if (send_pack(client_fd, 2, &answer, sizeof(base), NULL) == 1){  // CONNACC.
+        return;
+    }
+    uint64_t left = be64toh(received.length);
+    for (uint64_t pack_id = 0; left > 0; pack_id++){
+        data_msg data;
+        if (tcp_read(client_fd, &id, sizeof(uint8_t)) == 1 || tcp_read(client_fd, &data, sizeof(data_msg)) == 1){
+            return;
+        }
+        uint32_t len = be32toh(data.byte_len);
+        if (id != 4 || data.session_id != received.session_id || be64toh(data.pack_id) != pack_id || len > MAX_MSG || len > left){
+            fprintf(stderr, "ERROR: Wrong DATA package.\n");
+            send_status(client_fd, 6, data.session_id, be64toh(data.pack_id), NULL);  // RJT.
+            return;
+        }
+        if (tcp_read(client_fd, buff, len) == 1 || write(STDOUT_FILENO, buff, len) != (ssize_t) len){
+            return;
+        }
+        left -= len;
+    }
+    send_pack(client_fd, 7, &answer, sizeof(base), NULL);  // RCVD.
+}
+
+
+// Receives messages from UDP and UDPR clients, one session at a time.
+void udp_server(int socket_fd){
+    static char buff[sizeof(uint8_t) + sizeof(data_msg) + MAX_MSG];
+    bool connected = false;
+    bool udpr = false;
+    uint64_t sess_id = 0;
+    uint64_t left = 0;
+    uint64_t next = 0;  // ID of the next DATA.
+    for (;;){
+        struct sockaddr_in address;
+        socklen_t address_length = sizeof(address);
+        ssize_t got = recvfrom(socket_fd, buff, sizeof(buff), 0, (struct sockaddr *) &address, &address_length);
+        if (got < 0){  // Client went silent.
+            connected = false;
+            continue;
+        }
+        if (buff[0] == 1 && got == sizeof(uint8_t) + sizeof(conn)){  // CONN.
+            conn received;
+            memcpy(&received, buff + sizeof(uint8_t), sizeof(conn));
+            base answer = {.session_id = received.session_id};
+            if (received.protocol != 2 && received.protocol != 3){  // Flags weren't known yet, CONN is dropped.
+                fprintf(stderr, "ERROR: Client tried to connect using wrong protocol.\n");
+            }
+            else if (connected && received.session_id != sess_id){
+                send_pack(socket_fd, 3, &answer, sizeof(base), &address);  // CONRJT.
+            }
+            else{
+                connected = true;
+                udpr = received.protocol == 3;
+                sess_id = received.session_id;
+                left = be64toh(received.length);
+                next = 0;
+                send_pack(socket_fd, 2, &answer, sizeof(base), &address);  // CONNACC.
+            }
+        }
+        else if (buff[0] == 4 && got >= (ssize_t) (sizeof(uint8_t) + sizeof(data_msg))){  // DATA.
+            data_msg data;
+            memcpy(&data, buff + sizeof(uint8_t), sizeof(data_msg));
+            uint64_t pack_id = be64toh(data.pack_id);
+            uint32_t len = be32toh(data.byte_len);
+            if (!connected || data.session_id != sess_id){
+                send_status(socket_fd, 6, data.session_id, pack_id, &address);  // RJT.
+            }
+            else if (udpr && pack_id < next){  // ACC was lost.
+                send_status(socket_fd, 5, sess_id, pack_id, &address);
+            }
+            else if (pack_id != next || len > left || got != (ssize_t) (sizeof(uint8_t) + sizeof(data_msg) + len)){
+                fprintf(stderr, "ERROR: Wrong DATA package.\n");
+                send_status(socket_fd, 6, sess_id, pack_id, &address);  // RJT.
+                connected = false;
+            }
+            else{
+                if (write(STDOUT_FILENO, buff + sizeof(uint8_t) + sizeof(data_msg), len) != (ssize_t) len){
+                    fprintf(stderr, "ERROR: Couldn't write message.\n");
+                }
+                left -= len;
+                next++;
+                if (udpr){
+                    send_status(socket_fd, 5, sess_id, pack_id, &address);  // ACC.
+                }
+                if (left == 0){
+                    base answer = {.session_id = sess_id};
+                    send_pack(socket_fd, 7, &answer, sizeof(base), &address);  // RCVD.
+                    connected = false;
+                }
+            }
+        }
+    }
+}
+
+
+int main(int argc, char *argv[]){
+    if (argc != 3 || (strcmp(argv[1], "tcp") != 0 && strcmp(argv[1], "udp") != 0)){
+        fprintf(stderr, "ERROR: Expected arguments: %s <tcp|udp> <port>\n", argv[0]);
+        return 1;
+    }
+    bool error = false;
+    uint16_t port = read_port(argv[2], &error);
+    if (error){
+        return 1;
+    }
+    bool tcp = strcmp(argv[1], "tcp") == 0;
+    int socket_fd = socket(AF_INET, tcp ? SOCK_STREAM : SOCK_DGRAM, 0);
+    struct sockaddr_in address = {.sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_ANY), .sin_port = htons(port)};
+    setsockopt(socket_fd, SOL_SOCKET, SO_REUSEADDR, &(int){1}, sizeof(int));
+    if (socket_fd < 0 || bind(socket_fd, (struct sockaddr *) &address, sizeof(address)) < 0 || (tcp && listen(socket_fd, 1) < 0)){
+        fprintf(stderr, "ERROR: Couldn't bind the socket.\n");
+        return 1;
+    }
+    struct timeval timeout = {.tv_sec = MAX_WAIT, .tv_usec = 0};
+    if (!tcp){
+        setsockopt(socket_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        udp_server(socket_fd);
+    }
+    for (;;){
+        int client_fd = accept(socket_fd, NULL, NULL);
+        if (client_fd < 0){
+            continue;
+        }
+        setsockopt(client_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        tcp_client(client_fd);
+        close(client_fd);
+    }
+}
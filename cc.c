@@ -0,0 +1,172 @@
+#include "common.h"
+#include "protconst.h"
+#include "cc.h"
+
+
+// Reno: window grows by one package every round trip and is halved on loss.
+static void aimd_ack(congestion *control, uint64_t acked, uint64_t srtt){
+    (void) srtt;
+    if (control->cwnd < control->ssthresh){  // Slow start.
+        control->cwnd += acked;
+    }
+    else{
+        control->cwnd += (double) acked / control->cwnd;
+    }
+}
+
+
+static void aimd_loss(congestion *control){
+    control->ssthresh = control->cwnd / 2 > 2 ? control->cwnd / 2 : 2;
+    control->cwnd = control->ssthresh;
+}
+
+
+// Vegas: packages queued on the path are estimated from how much the round trip time grew
+// over the shortest one. Window grows while few are queued and shrinks when queues build up.
+static void delay_ack(congestion *control, uint64_t acked, uint64_t srtt){
+    if (srtt == 0 || control->min_rtt == 0){
+        aimd_ack(control, acked, srtt);
+        return;
+    }
+    double queued = control->cwnd * (srtt - (srtt > control->min_rtt ? control->min_rtt : srtt)) / srtt;
+    if (control->cwnd < control->ssthresh && queued < DELAY_ALPHA){  // Slow start.
+        control->cwnd += acked;
+    }
+    else if (queued < DELAY_ALPHA){
+        control->ssthresh = control->cwnd < control->ssthresh ? control->cwnd : control->ssthresh;
+        control->cwnd += (double) acked / control->cwnd;
+    }
+    else if (queued > DELAY_BETA){
+        control->ssthresh = control->cwnd < control->ssthresh ? control->cwnd : control->ssthresh;
+        control->cwnd -= (double) acked / control->cwnd;
+    }
+}
+
+
+static void delay_loss(congestion *control){
+    control->ssthresh = control->cwnd * 3 / 4 > 2 ? control->cwnd * 3 / 4 : 2;
+    control->cwnd = control->ssthresh;
+}
+
+
+static cc_ops const algorithms[] = {
+    {.name = "aimd", .ack = aimd_ack, .loss = aimd_loss},
+    {.name = "delay", .ack = delay_ack, .loss = delay_loss},
+};
+
+
+// Finds algorithm with given name, NULL if there is none.
+cc_ops const *cc_find(char const *name){
+    for (size_t i = 0; i < sizeof(algorithms) / sizeof(algorithms[0]); i++){
+        if (strcmp(algorithms[i].name, name) == 0){
+            return &algorithms[i];
+        }
+    }
+    return NULL;
+}
+
+
+// Sets pacing rate from the window, so it is spread over a round trip. Writes trace line.
+// Window is sent faster than that in slow start, so it can grow.
+static void cc_update(congestion *control, uint64_t srtt, uint64_t now, char const *event){
+    if (control->cwnd < 1){
+        control->cwnd = 1;
+    }
+    control->rate = control->max_rate;
+    if (control->ops != NULL && srtt > 0){
+        double gain = control->cwnd < control->ssthresh ? 2 : 1.25;
+        uint64_t rate = gain * control->cwnd * control->package * 1e6 / srtt;
+        if (control->rate == 0 || rate < control->rate){
+            control->rate = rate;
+        }
+    }
+    if (control->trace != NULL){
+        fprintf(control->trace, "%" PRIu64 " %s %.2f %.2f %" PRIu64 " %" PRIu64 " %" PRIu64 "\n", now - control->start, event,
+                control->cwnd, control->ssthresh, srtt, control->min_rtt, control->rate);
+    }
+}
+
+
+// Starts transfer at 'now' with given algorithm and rate limit, 'srtt' was measured by the handshake.
+void cc_init(congestion *control, cc_ops const *ops, uint64_t max_rate, FILE *trace, uint64_t srtt, uint64_t now){
+    control->ops = ops;
+    control->cwnd = CC_INITIAL_WINDOW;
+    control->ssthresh = 1e9;  // Slow start lasts until the first loss.
+    control->min_rtt = srtt;
+    control->recovery = 0;
+    control->max_rate = max_rate;
+    control->package = MAX_MSG;
+    control->next_send = now;
+    control->start = now;
+    control->trace = trace;
+    if (trace != NULL){
+        fprintf(trace, "# us event cwnd ssthresh srtt_us min_rtt_us rate_Bps\n");
+    }
+    cc_update(control, srtt, now, "start");
+}
+
+
+// Notes 'acked' newly confirmed packages. 'sample' is round trip time measured by them, 0 if none.
+void cc_ack(congestion *control, uint64_t acked, uint64_t sample, uint64_t srtt, uint64_t now){
+    if (sample > 0 && (control->min_rtt == 0 || sample < control->min_rtt)){
+        control->min_rtt = sample;
+    }
+    if (control->ops == NULL || acked == 0){
+        return;
+    }
+    control->ops->ack(control, acked, srtt);
+    cc_update(control, srtt, now, "ack");
+}
+
+
+// Notes lost package 'pack_id', 'next' is the next package sent for the first time.
+// Losses of packages sent before the window was reduced don't reduce it again.
+void cc_loss(congestion *control, uint64_t pack_id, uint64_t next, uint64_t srtt, uint64_t now){
+    if (control->ops == NULL || pack_id < control->recovery){
+        return;
+    }
+    control->recovery = next;
+    control->ops->loss(control);
+    cc_update(control, srtt, now, "loss");
+}
+
+
+// Notes retransmission timeout, window starts over.
+void cc_timeout(congestion *control, uint64_t next, uint64_t srtt, uint64_t now){
+    if (control->ops == NULL){
+        return;
+    }
+    control->recovery = next;
+    control->ssthresh = control->cwnd / 2 > 2 ? control->cwnd / 2 : 2;
+    control->cwnd = 1;
+    cc_update(control, srtt, now, "timeout");
+}
+
+
+// Number of packages allowed in flight, at most 'limit'.
+size_t cc_window(congestion const *control, size_t limit){
+    if (control->ops == NULL || control->cwnd >= limit){
+        return limit;
+    }
+    return (size_t) control->cwnd;
+}
+
+
+// Package may be sent at 'now' without exceeding the pacing rate.
+bool cc_ready(congestion const *control, uint64_t now){
+    return control->rate == 0 || control->next_send <= now;
+}
+
+
+// Notes package of 'bytes' sent at 'now'.
+// Schedule lags at most 'PACING_BURST' us behind, so that much may be sent at once after a pause.
+void cc_sent(congestion *control, uint32_t bytes, uint64_t now){
+    control->package = bytes > 0 ? bytes : 1;
+    if (control->rate == 0){
+        return;
+    }
+    if (control->next_send + PACING_BURST < now){
+        control->next_send = now - PACING_BURST;
+    }
+    control->next_send += (bytes * 1000000ULL + control->rate - 1) / control->rate;
+}
@@ -0,0 +1,59 @@
+#ifndef CC_H
+#define CC_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+struct congestion;
+
+// Congestion control algorithm, chosen by name.
+typedef struct cc_ops{
+    char const *name;
+    // Grows window after 'acked' packages were confirmed, 'srtt' is the smoothed round trip time (us).
+    void (*ack)(struct congestion *control, uint64_t acked, uint64_t srtt);
+    // Shrinks window after a loss, at most once per round trip.
+    void (*loss)(struct congestion *control);
+} cc_ops;
+
+// Congestion window and pacing of one transfer.
+typedef struct congestion{
+    cc_ops const *ops;       // NULL if window isn't limited.
+    double cwnd;             // Packages allowed in flight.
+    double ssthresh;         // Slow start ends at this window.
+    uint64_t min_rtt;        // Shortest round trip time measured (us), 0 before the first sample.
+    uint64_t recovery;       // Losses of packages sent before it belong to the last congestion event.
+    uint64_t max_rate;       // Pacing rate limit (bytes/s), 0 if not limited.
+    uint64_t rate;           // Current pacing rate (bytes/s), 0 if packages aren't paced.
+    uint32_t package;        // Size of the last package sent (bytes).
+    uint64_t next_send;      // Time (us) when the next package may be sent.
+    uint64_t start;          // Time (us) the transfer started, trace times are relative to it.
+    FILE *trace;             // Window and rate changes are written there, NULL if not traced.
+} congestion;
+
+// Finds algorithm with given name, NULL if there is none.
+cc_ops const *cc_find(char const *name);
+
+// Starts transfer at 'now' with given algorithm and rate limit, 'srtt' was measured by the handshake.
+void cc_init(congestion *control, cc_ops const *ops, uint64_t max_rate, FILE *trace, uint64_t srtt, uint64_t now);
+
+// Notes 'acked' newly confirmed packages. 'sample' is round trip time measured by them, 0 if none.
+void cc_ack(congestion *control, uint64_t acked, uint64_t sample, uint64_t srtt, uint64_t now);
+
+// Notes lost package 'pack_id', 'next' is the next package sent for the first time.
+void cc_loss(congestion *control, uint64_t pack_id, uint64_t next, uint64_t srtt, uint64_t now);
+
+// Notes retransmission timeout, window starts over.
+void cc_timeout(congestion *control, uint64_t next, uint64_t srtt, uint64_t now);
+
+// Number of packages allowed in flight, at most 'limit'.
+size_t cc_window(congestion const *control, size_t limit);
+
+// Package may be sent at 'now' without exceeding the pacing rate.
+bool cc_ready(congestion const *control, uint64_t now);
+
+// Notes package of 'bytes' sent at 'now'.
+void cc_sent(congestion *control, uint32_t bytes, uint64_t now);
+
+#endif
@@ -0,0 +1,59 @@
+#include <fcntl.h>
+#include <sys/file.h>
+#include "common.h"
+#include "checkpoint.h"
+
+
+// Opens record of the transfer in directory 'dir', an empty one if the transfer is new, and reads its offset.
+// Returns 1 if it can't be opened or another session is sending the transfer.
+int checkpoint_open(checkpoint *c, int dir, uint32_t id, uint64_t digest, uint64_t length, uint64_t *offset){
+    c->length = length;
+    snprintf(c->name, sizeof(c->name), "%08" PRIx32 "-%016" PRIx64 "-%016" PRIx64, id, digest, length);
+    c->fd = openat(dir, c->name, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (c->fd < 0){
+        fprintf(stderr, "ERROR: Couldn't open record of the transfer.\n");
+        return 1;
+    }
+    if (flock(c->fd, LOCK_EX | LOCK_NB) < 0){  // Lock is dropped with the descriptor, also when the server dies.
+        fprintf(stderr, "ERROR: Transfer is already being sent.\n");
+        close(c->fd);
+        c->fd = -1;
+        return 1;
+    }
+    uint64_t saved = 0;
+    ssize_t got = pread(c->fd, &saved, sizeof(saved), 0);
+    *offset = got == sizeof(saved) ? be64toh(saved) : 0;  // New record is empty.
+    if (got < 0 || *offset > length){
+        fprintf(stderr, "ERROR: Record of the transfer is broken.\n");
+        checkpoint_close(c);
+        return 1;
+    }
+    return 0;
+}
+
+
+// Records that first 'offset' bytes of the message are written.
+// Record isn't synced, like the output it outlives the server process, not the system.
+int checkpoint_save(checkpoint const *c, uint64_t offset){
+    uint64_t saved = htobe64(offset);
+    if (pwrite(c->fd, &saved, sizeof(saved), 0) != sizeof(saved)){
+        fprintf(stderr, "ERROR: Couldn't record progress of the transfer.\n");
+        return 1;
+    }
+    return 0;
+}
+
+
+// Closes the record, a later session resumes from its offset.
+void checkpoint_close(checkpoint *c){
+    close(c->fd);
+    c->fd = -1;
+}
+
+
+// Records that the whole message is written and closes the record.
+// It stays, so a client which didn't get RCVD finds the transfer complete when it tries again.
+void checkpoint_finish(checkpoint *c){
+    checkpoint_save(c, c->length);
+    checkpoint_close(c);
+}
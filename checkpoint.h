@@ -0,0 +1,29 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Record of how much of a resumable transfer was written to the output, in a file named after the transfer.
+// The file holds the offset as 8 bytes big endian. It is locked while a session sends the transfer.
+// Record of a complete transfer stays, the same message sent again under the same ID is only confirmed.
+typedef struct checkpoint{
+    int fd;                  // Open record, -1 if the transfer isn't resumable.
+    uint64_t length;         // Size of the whole message.
+    char name[48];           // File name, from transfer ID chosen by the client, digest and size of the message.
+} checkpoint;
+
+// Opens record of the transfer in directory 'dir', an empty one if the transfer is new, and reads its offset.
+// Returns 1 if it can't be opened or another session is sending the transfer.
+int checkpoint_open(checkpoint *c, int dir, uint32_t id, uint64_t digest, uint64_t length, uint64_t *offset);
+
+// Records that first 'offset' bytes of the message are written.
+int checkpoint_save(checkpoint const *c, uint64_t offset);
+
+// Closes the record, a later session resumes from its offset.
+void checkpoint_close(checkpoint *c);
+
+// Records that the whole message is written and closes the record.
+void checkpoint_finish(checkpoint *c);
+
+#endif
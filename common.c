@@ -1,3 +1,4 @@
+#include <time.h>
 #include "common.h"
 
 // Creates conn pack with given data.
@@ -25,6 +26,98 @@ void create_status(status *pack, uint64_t sess_id, uint64_t pack_id){
     pack->pack_id = htobe64(pack_id);
 }
 
+// Creates windowed ACC pack with given data.
+void create_window_ack(window_ack *pack, uint64_t sess_id, uint64_t pack_id, uint64_t mask){
+    pack->session_id = sess_id;
+    pack->pack_id = htobe64(pack_id);
+    pack->mask = htobe64(mask);
+}
+
+// Creates NACK pack with given data.
+void create_nack(nack *pack, uint64_t sess_id, uint64_t pack_id, uint64_t highest, uint16_t count){
+    pack->session_id = sess_id;
+    pack->pack_id = htobe64(pack_id);
+    pack->highest = htobe64(highest);
+    pack->count = htobe16(count);
+}
+
+// Creates range of NACK pack.
+void create_nack_range(nack_range *range, uint64_t first, uint32_t count){
+    range->first = htobe64(first);
+    range->count = htobe32(count);
+}
+
+// Writes capabilities given in 'caps' into 'buff', which has 'CAPS_SIZE' bytes. Returns number of bytes written.
+size_t write_capabilities(char *buff, capabilities const *caps){
+    uint32_t const values[] = {caps->payload, caps->window, caps->timeout, caps->messages, caps->stripes, caps->stripe,
+                               caps->resume, (uint32_t) (caps->digest >> 32), (uint32_t) caps->digest};
+    uint8_t const types[] = {CAP_PAYLOAD, CAP_WINDOW, CAP_TIMEOUT, CAP_MESSAGES, CAP_STRIPES, CAP_STRIPE, CAP_RESUME, CAP_DIGEST,
+                             CAP_DIGEST_LOW};
+    uint8_t count = 0;
+    for (size_t i = 0; i < sizeof(types); i++){
+        if (values[i] != 0){
+            capability cap = {.type = types[i], .value = htobe32(values[i])};
+            memcpy(buff + sizeof(uint8_t) + count * sizeof(capability), &cap, sizeof(capability));
+            count++;
+        }
+    }
+    memcpy(buff, &count, sizeof(uint8_t));
+    return sizeof(uint8_t) + count * sizeof(capability);
+}
+
+// Size of capabilities at 'buff', 0 if even their count isn't among 'len' bytes.
+size_t capabilities_size(char const *buff, size_t len){
+    if (len < sizeof(uint8_t)){
+        return 0;
+    }
+    return sizeof(uint8_t) + (uint8_t) buff[0] * sizeof(capability);
+}
+
+// Reads complete capabilities at 'buff' into 'caps', unknown ones are skipped.
+void read_capabilities(char const *buff, capabilities *caps){
+    *caps = (capabilities) {0};
+    for (uint8_t i = 0; i < (uint8_t) buff[0]; i++){
+        capability cap;
+        memcpy(&cap, buff + sizeof(uint8_t) + i * sizeof(capability), sizeof(capability));
+        if (cap.type == CAP_PAYLOAD){
+            caps->payload = be32toh(cap.value);
+        }
+        else if (cap.type == CAP_WINDOW){
+            caps->window = be32toh(cap.value);
+        }
+        else if (cap.type == CAP_TIMEOUT){
+            caps->timeout = be32toh(cap.value);
+        }
+        else if (cap.type == CAP_MESSAGES){
+            caps->messages = be32toh(cap.value);
+        }
+        else if (cap.type == CAP_STRIPES){
+            caps->stripes = be32toh(cap.value);
+        }
+        else if (cap.type == CAP_STRIPE){
+            caps->stripe = be32toh(cap.value);
+        }
+        else if (cap.type == CAP_RESUME){
+            caps->resume = be32toh(cap.value);
+        }
+        else if (cap.type == CAP_DIGEST){
+            caps->digest |= (uint64_t) be32toh(cap.value) << 32;
+        }
+        else if (cap.type == CAP_DIGEST_LOW){
+            caps->digest |= be32toh(cap.value);
+        }
+    }
+}
+
+// Creates PARITY pack with given data.
+void create_parity(parity_msg *pack, uint64_t sess_id, uint64_t pack_id, uint32_t count, uint32_t len_xor, uint32_t byte_len){
+    pack->session_id = sess_id;
+    pack->pack_id = htobe64(pack_id);
+    pack->count = htobe32(count);
+    pack->len_xor = htobe32(len_xor);
+    pack->byte_len = htobe32(byte_len);
+}
+
 // Checks if malloc allocated spacer on 'pointer'.
 int malloc_error(void* pointer){
     if (pointer == NULL){  // If there was a problem allocating space.
@@ -35,6 +128,14 @@ int malloc_error(void* pointer){
 }
 
 
+// Current monotonic time in microseconds.
+uint64_t mono_us(void){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000 + (uint64_t) now.tv_nsec / 1000;
+}
+
+
 // Creates port.
 uint16_t read_port(char const *string, bool *error) {
     char *endptr;
@@ -47,6 +148,19 @@ uint16_t read_port(char const *string, bool *error) {
 }
 
 
+// Reads number from range [min, max] given as an option.
+uint64_t read_number(char const *string, uint64_t min, uint64_t max, bool *error){
+    char *endptr;
+    errno = 0;
+    unsigned long long number = strtoull(string, &endptr, 10);
+    if (errno == ERANGE || *endptr != 0 || *string == 0 || *string == '-' || number < min || number > max){
+        fprintf(stderr, "ERROR: %s is not a valid number.\n", string);
+        *error = true;
+    }
+    return (uint64_t) number;
+}
+
+
 // Sends messages using TCP protocol.
 int tcp_write(int socket_fd, void *data, uint32_t size){
     uint32_t to_write = size;  // Size to write.
@@ -64,6 +178,27 @@ int tcp_write(int socket_fd, void *data, uint32_t size){
 }
 
 
+// Sends 'count' buffers using TCP protocol, with as few syscalls as possible. Modifies 'parts'.
+int tcp_writev(int socket_fd, struct iovec *parts, int count){
+    while (count > 0){
+        ssize_t done = writev(socket_fd, parts, count);
+        if (done <= 0){  // Error while sending.
+            return 1;
+        }
+        while (count > 0 && (size_t) done >= parts->iov_len){  // Skipping fully sent buffers.
+            done -= parts->iov_len;
+            parts++;
+            count--;
+        }
+        if (count > 0){  // Partly sent buffer.
+            parts->iov_base = (char *) parts->iov_base + done;
+            parts->iov_len -= done;
+        }
+    }
+    return 0;
+}
+
+
 // Receives messages using TCP protocol.
 int tcp_read(int socket_fd, void* data, uint32_t size){
     uint32_t to_read = size;  // Size to read.
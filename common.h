@@ -1,3 +1,6 @@
+#ifndef COMMON_H
+#define COMMON_H
+
 
 // Max package size.
 #include <stdio.h>
@@ -8,11 +11,33 @@
 #include <inttypes.h>
 #include <stdbool.h>
 #include <unistd.h>
+#include <sys/uio.h>
 
 #define MAX_MSG 64000
 #define BUFFOR_SIZE 64000
 #define MAX_QUEUE 100
 
+// CONN 'protocol' holds protocol ID in low bits and flags of requested extensions in high bits.
+#define PROT_ID 0x0f
+#define PROT_EARLY 0x10   // UDP/UDPR CONN datagram ends with the first DATA package.
+#define PROT_FEC 0x20     // UDP client sends PARITY after every block of DATA packages.
+#define PROT_STREAM 0x40  // Length is unknown, message ends with an empty DATA.
+#define PROT_EXT 0x80     // CONN is followed by offered capabilities, CONNACC by the agreed ones.
+
+// Capabilities follow CONN and CONNACC as a count byte and 'count' of them.
+// Server leaves out of its answer those it doesn't know or doesn't agree to, defaults hold for them.
+#define CAP_PAYLOAD 1     // Max data size of DATA package.
+#define CAP_WINDOW 2      // Max number of unconfirmed packages of windowed client.
+#define CAP_TIMEOUT 3     // Time (ms) without packages after which the transfer fails.
+#define CAP_MESSAGES 4    // Stream carries messages framed by 'frame_head', each confirmed with DONE. Value is 1.
+#define CAP_STRIPES 5     // Session sends one of that many byte ranges of a transfer, whose ID is the first 4 bytes of session ID.
+#define CAP_STRIPE 6      // Index of the range, the first one if not given.
+#define CAP_RESUME 7      // Transfer ID chosen by the client, a later transfer of the same message resumes where it ended.
+#define CAP_DIGEST 8      // High half of 64-bit hash of the whole message, with its size and transfer ID it names the transfer.
+#define CAP_DIGEST_LOW 9  // Low half of the hash.
+// Server which agrees to CAP_RESUME follows capabilities of CONNACC with offset (uint64) of the first byte to send,
+// the rest of the message is sent in DATA packages numbered from 0.
+
 // Conn package components.
 typedef struct __attribute__ ((__packed__)) conn{
     uint64_t session_id;
@@ -38,6 +63,67 @@ typedef struct __attribute__ ((__packed__)) status{
     uint64_t pack_id;
 } status;
 
+// Header of a message in the stream of a session, its 'length' bytes of data follow. Client reads such records
+// from stdin and server writes them to stdout unchanged.
+// Server confirms messages written so far with DONE, a status package whose 'pack_id' is their number.
+// Range of a striped transfer received whole is confirmed with PART, a base package, or with RCVD if it completes the transfer.
+typedef struct __attribute__ ((__packed__)) frame_head{
+    uint32_t length;
+} frame_head;
+
+// ACC components in windowed mode. All packages before 'pack_id' are received,
+// bit i of 'mask' is set if package 'pack_id' + 1 + i is received too.
+typedef struct __attribute__ ((__packed__)) window_ack{
+    uint64_t session_id;
+    uint64_t pack_id;
+    uint64_t mask;
+} window_ack;
+
+// NACK components, followed by 'count' ranges of missing packages.
+// All packages before 'pack_id' are received, none from 'highest' on.
+typedef struct __attribute__ ((__packed__)) nack{
+    uint64_t session_id;
+    uint64_t pack_id;
+    uint64_t highest;
+    uint16_t count;
+} nack;
+
+// Range of missing packages in NACK.
+typedef struct __attribute__ ((__packed__)) nack_range{
+    uint64_t first;
+    uint32_t count;
+} nack_range;
+
+// Capability components, 'value' is its limit.
+typedef struct __attribute__ ((__packed__)) capability{
+    uint8_t type;
+    uint32_t value;
+} capability;
+
+// Limits of a transfer, 0 where no capability was given.
+typedef struct capabilities{
+    uint32_t payload;
+    uint32_t window;
+    uint32_t timeout;
+    uint32_t messages;
+    uint32_t stripes;
+    uint32_t stripe;
+    uint32_t resume;
+    uint64_t digest;         // Sent as two capabilities.
+} capabilities;
+
+#define CAPS_SIZE (sizeof(uint8_t) + 9 * sizeof(capability))  // Room for all known capabilities.
+
+// PARITY components, followed by 'byte_len' bytes of XOR of data of 'count' packages from 'pack_id' on.
+// 'len_xor' is XOR of their sizes, so size of a rebuilt package is known.
+typedef struct __attribute__ ((__packed__)) parity_msg{
+    uint64_t session_id;
+    uint64_t pack_id;
+    uint32_t count;
+    uint32_t len_xor;
+    uint32_t byte_len;
+} parity_msg;
+
 
 void create_conn(conn *pack, uint64_t sess_id, uint8_t prot, uint64_t len);
 
@@ -50,17 +136,50 @@ void create_data(data_msg *pack, uint64_t sess_id, uint64_t pack_id, uint32_t by
 // Creates status pack with given data.
 void create_status(status *pack, uint64_t sess_id, uint64_t pack_id);
 
+// Creates windowed ACC pack with given data.
+void create_window_ack(window_ack *pack, uint64_t sess_id, uint64_t pack_id, uint64_t mask);
+
+// Creates PARITY pack with given data.
+void create_parity(parity_msg *pack, uint64_t sess_id, uint64_t pack_id, uint32_t count, uint32_t len_xor, uint32_t byte_len);
+
+// Creates NACK pack with given data.
+void create_nack(nack *pack, uint64_t sess_id, uint64_t pack_id, uint64_t highest, uint16_t count);
+
+// Creates range of NACK pack.
+void create_nack_range(nack_range *range, uint64_t first, uint32_t count);
+
+// Writes capabilities given in 'caps' into 'buff', which has 'CAPS_SIZE' bytes. Returns number of bytes written.
+size_t write_capabilities(char *buff, capabilities const *caps);
+
+// Size of capabilities at 'buff', 0 if even their count isn't among 'len' bytes.
+size_t capabilities_size(char const *buff, size_t len);
+
+// Reads complete capabilities at 'buff' into 'caps', unknown ones are skipped.
+void read_capabilities(char const *buff, capabilities *caps);
+
 // Checks if malloc allocated spacer on 'pointer'.
 int malloc_error(void* pointer);
 
+// Current monotonic time in microseconds.
+uint64_t mono_us(void);
+
 
 // Creates port.
 uint16_t read_port(char const *string, bool *error);
 
+// Reads number from range [min, max] given as an option.
+uint64_t read_number(char const *string, uint64_t min, uint64_t max, bool *error);
+
 
 // Writing while tcp.
 int tcp_write(int socket_fd, void *data, uint32_t size);
 
 
+// Writing 'count' buffers at once while tcp. Modifies 'parts'.
+int tcp_writev(int socket_fd, struct iovec *parts, int count);
+
+
 // Reading while tcp.
-int tcp_read(int socket_fd, void* data, uint32_t size);
\ No newline at end of file
+int tcp_read(int socket_fd, void* data, uint32_t size);
+
+#endif
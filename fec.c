@@ -0,0 +1,45 @@
+#include <string.h>
+#include "fec.h"
+
+// Unit of the XOR kernel.
+typedef uint64_t fec_vector __attribute__ ((vector_size (32)));
+
+
+// Starts empty block at package 'first'.
+void fec_reset(fec_block *block, uint64_t first){
+    block->first = first;
+    block->count = 0;
+    block->len_xor = 0;
+    block->byte_len = 0;
+}
+
+
+// XORs 'len' bytes of 'src' into 'dst'.
+// Bulk of the data is handled in 32 byte vectors, the compiler maps them to SIMD registers.
+void fec_xor(char *restrict dst, char const *restrict src, size_t len){
+    size_t i = 0;
+    for (; i + sizeof(fec_vector) <= len; i += sizeof(fec_vector)){
+        fec_vector a, b;
+        memcpy(&a, dst + i, sizeof(fec_vector));  // Buffers don't have to be aligned.
+        memcpy(&b, src + i, sizeof(fec_vector));
+        a ^= b;
+        memcpy(dst + i, &a, sizeof(fec_vector));
+    }
+    for (; i < len; i++){
+        dst[i] ^= src[i];
+    }
+}
+
+
+// Adds package to the block, 'parity' has room for the longest package.
+// Bytes past the longest package so far are zeros in the parity, so they are copied.
+void fec_add(fec_block *block, char *restrict parity, char const *restrict data, uint32_t byte_len){
+    uint32_t common = byte_len < block->byte_len ? byte_len : block->byte_len;
+    fec_xor(parity, data, common);
+    if (byte_len > block->byte_len){
+        memcpy(parity + common, data + common, byte_len - common);
+        block->byte_len = byte_len;
+    }
+    block->len_xor ^= byte_len;
+    block->count++;
+}
@@ -0,0 +1,25 @@
+#ifndef FEC_H
+#define FEC_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// XOR parity of a block of DATA packages. A single lost package of the block
+// is the XOR of the parity with all other packages, shorter ones padded with zeros.
+typedef struct fec_block{
+    uint64_t first;          // ID of the first package of the block.
+    uint32_t count;          // Packages added to the parity.
+    uint32_t len_xor;        // XOR of their sizes.
+    uint32_t byte_len;       // Size of the longest one, parity is that long.
+} fec_block;
+
+// Starts empty block at package 'first'.
+void fec_reset(fec_block *block, uint64_t first);
+
+// XORs 'len' bytes of 'src' into 'dst'.
+void fec_xor(char *restrict dst, char const *restrict src, size_t len);
+
+// Adds package to the block, 'parity' has room for the longest package.
+void fec_add(fec_block *block, char *restrict parity, char const *restrict data, uint32_t byte_len);
+
+#endif
@@ -0,0 +1,48 @@
+#include <string.h>
+#include "frame.h"
+
+
+// Starts before the header of the first message.
+void framer_init(framer *frames){
+    frames->messages = 0;
+    frames->left = 0;
+    frames->head_len = 0;
+}
+
+
+// Follows 'len' bytes of the stream, counting messages which end among them.
+// Header bytes are copied until the header is whole, data is only skipped.
+void framer_scan(framer *frames, char const *data, size_t len){
+    while (len > 0){
+        if (frames->left == 0){  // Header of the next message.
+            size_t part = sizeof(frame_head) - frames->head_len;
+            part = part < len ? part : len;
+            memcpy(frames->head + frames->head_len, data, part);
+            frames->head_len += part;
+            data += part;
+            len -= part;
+            if (frames->head_len < sizeof(frame_head)){
+                return;
+            }
+            frames->head_len = 0;
+            frames->left = be32toh(((frame_head const *) frames->head)->length);
+            if (frames->left == 0){  // Empty message.
+                frames->messages++;
+            }
+            continue;
+        }
+        uint32_t part = len < frames->left ? len : frames->left;
+        frames->left -= part;
+        data += part;
+        len -= part;
+        if (frames->left == 0){
+            frames->messages++;
+        }
+    }
+}
+
+
+// Checks if the stream so far ends with a whole message.
+bool framer_whole(framer const *frames){
+    return frames->left == 0 && frames->head_len == 0;
+}
@@ -0,0 +1,27 @@
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "common.h"
+
+// Follows messages in the stream of a session, each is its 'frame_head' followed by its data.
+// Stream passes to the output unchanged, so the receiver sees the same records as the sender read.
+typedef struct framer{
+    uint64_t messages;       // Messages followed to their end.
+    uint32_t left;           // Data of the current message not followed yet.
+    uint8_t head_len;        // Bytes of the next header followed so far.
+    char head[sizeof(frame_head)];
+} framer;
+
+// Starts before the header of the first message.
+void framer_init(framer *frames);
+
+// Follows 'len' bytes of the stream, counting messages which end among them.
+void framer_scan(framer *frames, char const *data, size_t len);
+
+// Checks if the stream so far ends with a whole message.
+bool framer_whole(framer const *frames);
+
+#endif
@@ -0,0 +1,59 @@
+#include "common.h"
+#include "output.h"
+
+
+// Prepares empty output, 'lock' may be NULL.
+void output_init(output *out, size_t threshold, pthread_mutex_t *lock){
+    out->count = 0;
+    out->bytes = 0;
+    out->threshold = threshold;
+    out->lock = lock;
+    out->writes = 0;
+    out->failed = false;
+}
+
+
+// Adds data to the output, writes everything when threshold is reached.
+int output_push(output *out, void *data, size_t len){
+    if (len == 0){
+        return 0;
+    }
+    // Data continuing the previous part (e.g. next package in the same buffer) extends it.
+    if (out->count > 0 && (char *) out->parts[out->count - 1].iov_base + out->parts[out->count - 1].iov_len == data){
+        out->parts[out->count - 1].iov_len += len;
+    }
+    else{
+        if (out->count == OUTPUT_PARTS && output_flush(out) == 1){
+            return 1;
+        }
+        out->parts[out->count++] = (struct iovec) {.iov_base = data, .iov_len = len};
+    }
+    out->bytes += len;
+    if (out->bytes >= out->threshold){
+        return output_flush(out);
+    }
+    return 0;
+}
+
+
+// Writes all waiting data.
+int output_flush(output *out){
+    if (out->count == 0){
+        return 0;
+    }
+    if (out->lock != NULL){
+        pthread_mutex_lock(out->lock);  // Data of other threads can't be mixed into this one.
+    }
+    int code = tcp_writev(STDOUT_FILENO, out->parts, out->count);
+    if (out->lock != NULL){
+        pthread_mutex_unlock(out->lock);
+    }
+    out->writes++;
+    out->count = 0;
+    out->bytes = 0;
+    if (code == 1){
+        out->failed = true;
+        fprintf(stderr, "ERROR: Couldn't write received message.\n");
+    }
+    return code;
+}
@@ -0,0 +1,33 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <sys/uio.h>
+
+#define OUTPUT_PARTS 64
+
+// Data waiting to be written to stdout.
+// Parts point to caller's memory, which must stay untouched until the next flush.
+typedef struct output{
+    struct iovec parts[OUTPUT_PARTS];
+    int count;               // Number of waiting parts.
+    size_t bytes;            // Number of waiting bytes.
+    size_t threshold;        // Parts are written once that many bytes wait.
+    pthread_mutex_t *lock;   // Guards stdout shared with other threads, may be NULL.
+    uint64_t writes;         // Write syscalls.
+    bool failed;             // Some write failed, its data is lost. Cleared by the user.
+} output;
+
+// Prepares empty output, 'lock' may be NULL.
+void output_init(output *out, size_t threshold, pthread_mutex_t *lock);
+
+// Adds data to the output, writes everything when threshold is reached.
+int output_push(output *out, void *data, size_t len);
+
+// Writes all waiting data.
+int output_flush(output *out);
+
+#endif
@@ -0,0 +1,49 @@
+#include "common.h"
+#include "pool.h"
+
+
+// Allocates 'size' buffers of 'buffer_size' bytes.
+int pool_init(pool *buffers, size_t size, size_t buffer_size){
+    buffers->buffers = malloc((size > 0 ? size : 1) * buffer_size);
+    buffers->free = malloc((size > 0 ? size : 1) * sizeof(uint32_t));
+    if (malloc_error(buffers->buffers) == 1 || malloc_error(buffers->free) == 1){
+        free(buffers->buffers);
+        free(buffers->free);
+        return 1;
+    }
+    for (size_t i = 0; i < size; i++){  // Lowest indices are taken first.
+        buffers->free[i] = size - 1 - i;
+    }
+    buffers->available = size;
+    buffers->size = size;
+    buffers->buffer_size = buffer_size;
+    return 0;
+}
+
+
+// Frees pool memory.
+void pool_free(pool *buffers){
+    free(buffers->buffers);
+    free(buffers->free);
+}
+
+
+// Takes a free buffer. Returns its index, POOL_NONE if all are taken.
+uint32_t pool_get(pool *buffers){
+    if (buffers->available == 0){
+        return POOL_NONE;
+    }
+    return buffers->free[--buffers->available];
+}
+
+
+// Returns buffer to the pool.
+void pool_put(pool *buffers, uint32_t index){
+    buffers->free[buffers->available++] = index;
+}
+
+
+// Memory of the buffer with given index.
+char *pool_buffer(pool *buffers, uint32_t index){
+    return buffers->buffers + (size_t) index * buffers->buffer_size;
+}
@@ -0,0 +1,33 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Preallocated buffers of equal size, taken and returned in any order.
+typedef struct pool{
+    char *buffers;           // 'size' buffers of 'buffer_size' bytes.
+    uint32_t *free;          // Indices of free buffers, first 'available' are valid.
+    size_t available;        // Number of free buffers.
+    size_t size;             // Number of all buffers.
+    size_t buffer_size;
+} pool;
+
+#define POOL_NONE UINT32_MAX
+
+// Allocates 'size' buffers of 'buffer_size' bytes.
+int pool_init(pool *buffers, size_t size, size_t buffer_size);
+
+// Frees pool memory.
+void pool_free(pool *buffers);
+
+// Takes a free buffer. Returns its index, POOL_NONE if all are taken.
+uint32_t pool_get(pool *buffers);
+
+// Returns buffer to the pool.
+void pool_put(pool *buffers, uint32_t index);
+
+// Memory of the buffer with given index.
+char *pool_buffer(pool *buffers, uint32_t index);
+
+#endif
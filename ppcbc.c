@@ -2,14 +2,129 @@
 #include <netdb.h>
 #include <unistd.h>
 #include <time.h>
+#include <sys/random.h>
+#include <getopt.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <netinet/tcp.h>
 #include "common.h"
 #include "protconst.h"
+#include "rtt.h"
+#include "fec.h"
+#include "cc.h"
+#include "frame.h"
+
+
+// Client settings given as options.
+typedef struct client_config{
+    size_t batch;            // Max number of UDP DATA packages sent with one syscall.
+    uint64_t gap;            // Pause between batches (us).
+    bool stats;              // Report statistics on stderr.
+    bool stream;             // Length is unknown, stdin is sent while it is read.
+    size_t window;           // Max number of unconfirmed packages in windowed mode.
+    bool fec;                // UDP packages are followed by PARITY of every block.
+    cc_ops const *cc;        // Congestion control of windowed and NACK modes, NULL if there is none.
+    uint64_t rate;           // Max sending rate (bytes/s), 0 if not limited.
+    FILE *trace;             // Congestion window and rate changes are written there, NULL if not traced.
+    uint32_t size;           // Max size of DATA, 0 if UDP DATA follows path MTU.
+    bool gso;                // Batched packages of the same size are split by the kernel.
+    bool early;              // First DATA goes with CONN, in TCP SYN if the server gave a Fast Open cookie.
+    uint32_t timeout;        // Time (ms) without answer from the server after which the transfer fails.
+    bool ext;                // Settings are offered to the server as capabilities, it may lower them.
+    bool session;            // Stdin holds messages as records, each its 'frame_head' followed by its data.
+    uint32_t streams;        // Number of connections sending ranges of the message in parallel.
+    uint32_t resume;         // Transfer ID under which the server records progress, 0 if the transfer isn't resumable.
+} client_config;
+
+
+// Package sent in windowed mode.
+typedef struct window_slot{
+    char *data;              // Data of the package.
+    uint32_t byte_len;       // Size of the data.
+    uint64_t sent_at;        // Time (us) of the last transmission.
+    uint8_t reports;         // ACCs confirming later packages, but not this one.
+    bool acked;              // Server confirmed the package.
+    bool resent;             // Package was sent more than once.
+} window_slot;
+
+
+// Message read from stdin.
+typedef struct input{
+    char *msg;               // Whole message.
+    uint64_t len;            // Length of the message.
+    char *map;               // Start of the mapping, NULL if 'msg' was read into memory.
+    size_t map_len;          // Length of the mapping.
+} input;
+
+
+// Counters of the current transfer.
+static struct{
+    uint64_t packages;       // Sent packages.
+    uint64_t syscalls;       // Syscalls used to send them.
+    uint64_t start;          // Time (us) of the first DATA.
+    uint64_t streamed;       // Bytes read from stdin while sending.
+} sent;
+
+
+// Size of pipelined UDP DATA, follows path MTU and observed loss.
+static struct{
+    uint32_t current;        // Size of new packages.
+    uint32_t max;            // Largest size, sent without IP fragmentation unless given as an option.
+    uint32_t limit;          // Largest size the server takes.
+    uint64_t packages;       // New packages since the last adjustment.
+    uint64_t lost;           // Retransmitted packages since the last adjustment.
+    int socket_fd;           // Connected socket, its path MTU is read.
+    bool probe;              // 'max' follows path MTU.
+} payload = {.limit = MAX_MSG};
+
+
+// Messages of the session, records of stdin pass to the stream unchanged.
+static struct{
+    bool framed;             // Stdin is read as records.
+    framer read;             // Records read from stdin so far.
+    uint64_t confirmed;      // Messages the server confirmed with DONE.
+} messages;
+
+
+// Range of a striped transfer sent by this process.
+static struct{
+    uint32_t index;          // Index of the range.
+    uint32_t count;          // Number of ranges, 0 if the whole message is sent by one session.
+    int ready;               // Pipe written to once the session is accepted.
+    int go;                  // Pipe read from before data is sent, closed empty if another stripe failed.
+    bool part;               // Server confirmed the range with PART, another stripe got RCVD.
+} stripe;
+
+
+// Resumable transfer.
+static struct{
+    uint64_t digest;         // Hash of the whole message.
+    uint64_t offset;         // Bytes the server wrote in earlier transfers, they aren't sent again.
+} resume;
+
+
+// Round trip time estimation of the server.
+static rtt timer;
+
+
+// Congestion window and pacing of the transfer.
+static congestion control;
 
 
 // Generates random session ID.
+// IDs of clients started at the same time must differ, server tells clients apart by them.
 uint64_t gen_sess_id(){
     uint64_t sess = 0;
-    srand(time(0));
+    if (getrandom(&sess, sizeof(sess), 0) == sizeof(sess)){
+        return sess;
+    }
+    srand(time(0) ^ getpid());
     for (int i = 0; i < 64; i++){
         sess = sess * 2 + rand() % 2;
     }
@@ -19,8 +134,8 @@ uint64_t gen_sess_id(){
 
 // Calculates smaller value.
 size_t min_msg(uint64_t len){
-    if (len >= MAX_MSG){
-        return MAX_MSG;
+    if (len >= payload.limit){
+        return payload.limit;
     }
     else{
         return len;
@@ -28,6 +143,135 @@ size_t min_msg(uint64_t len){
 }
 
 
+// Hash of the message, so a resumed transfer isn't mistaken for another message sent under the same ID.
+// Words are mixed instead of bytes, a long message is hashed about as fast as it is read. Every step shifts
+// high bits down, so each bit of a word reaches all bits of the 64-bit result.
+static uint64_t message_digest(char const *msg, uint64_t len){
+    uint64_t hash = 0xcbf29ce484222325ULL ^ len;
+    uint64_t i = 0;
+    for (; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t)){
+        uint64_t word;
+        memcpy(&word, msg + i, sizeof(uint64_t));
+        hash = (hash ^ word) * 0x9e3779b97f4a7c15ULL;
+        hash ^= hash >> 32;
+    }
+    for (; i < len; i++){
+        hash = (hash ^ (uint8_t) msg[i]) * 0x9e3779b97f4a7c15ULL;
+        hash ^= hash >> 32;
+    }
+    hash ^= hash >> 33;  // Final mix of MurmurHash3.
+    hash *= 0xff51afd7ed558ccdULL;
+    return hash ^ (hash >> 33);
+}
+
+
+// Reads up to 'size' bytes of stdin into 'buff'.
+// Returns number of bytes read, less than 'size' only at the end of input, -1 on error.
+static ssize_t read_stdin(char *buff, size_t size){
+    size_t done = 0;
+    while (done < size){
+        ssize_t got = read(STDIN_FILENO, buff + done, size - done);
+        if (got < 0 && errno == EINTR){
+            continue;
+        }
+        if (got < 0){
+            fprintf(stderr, "ERROR: Couldn't read message.\n");
+            return -1;
+        }
+        if (got == 0){  // End of input.
+            break;
+        }
+        done += got;
+    }
+    sent.streamed += done;
+    return done;
+}
+
+
+// Reads up to 'size' bytes of the stream into 'buff'.
+// In session mode boundaries of the records are followed, so messages are counted and input can't end inside one.
+// Returns number of bytes read, less than 'size' only at the end of input, -1 on error.
+static ssize_t read_chunk(char *buff, size_t size){
+    ssize_t got = read_stdin(buff, size);
+    if (got < 0 || !messages.framed){
+        return got;
+    }
+    framer_scan(&messages.read, buff, got);
+    if ((size_t) got < size && !framer_whole(&messages.read)){  // End of input.
+        fprintf(stderr, "ERROR: Input ends inside a message.\n");
+        return -1;
+    }
+    return got;
+}
+
+
+// Notes DONE, 'pack' points to its status. It counts all messages written so far, so late ones change nothing.
+static void messages_done(char const *pack){
+    status done;
+    memcpy(&done, pack, sizeof(status));
+    uint64_t count = be64toh(done.pack_id);
+    messages.confirmed = count > messages.confirmed ? count : messages.confirmed;
+}
+
+
+// Largest DATA which fits in one IP packet on the path to the server.
+// Headers of PARITY are the longest, so it fits too.
+static uint32_t payload_mtu(void){
+    int mtu = 0;
+    socklen_t length = sizeof(mtu);
+    if (getsockopt(payload.socket_fd, IPPROTO_IP, IP_MTU, &mtu, &length) < 0){
+        return MAX_MSG;
+    }
+    int room = mtu - 20 - 8 - (int) (sizeof(uint8_t) + sizeof(parity_msg));  // IP and UDP headers.
+    uint32_t fits = room < PAYLOAD_MIN ? PAYLOAD_MIN : (uint32_t) room;
+    return fits < payload.limit ? fits : payload.limit;
+}
+
+
+// Sets size of DATA sent over 'socket_fd', which is connected to the server.
+// Path MTU is discovered by the kernel, packages larger than it are still fragmented.
+static void payload_init(int socket_fd, client_config const *config){
+    int discover = IP_PMTUDISC_WANT;
+    setsockopt(socket_fd, IPPROTO_IP, IP_MTU_DISCOVER, &discover, sizeof(discover));
+    payload.socket_fd = socket_fd;
+    payload.probe = config->size == 0;
+    payload.max = payload.probe ? payload_mtu() : config->size;
+    payload.current = payload.max;
+    payload.packages = 0;
+    payload.lost = 0;
+}
+
+
+// Lowers size of DATA to 'limit' agreed with the server.
+static void payload_agreed(uint32_t limit){
+    payload.limit = limit;
+    payload.max = payload.max < limit ? payload.max : limit;
+    payload.current = payload.current < limit ? payload.current : limit;
+}
+
+
+// Size of the next new package, when 'len' bytes are left.
+// Every 'PAYLOAD_PERIOD' packages size is halved if many of them were lost, fragments of large
+// packages are lost independently. It doubles back up to path MTU while few are lost.
+static uint32_t payload_next(uint64_t len){
+    if (++payload.packages >= PAYLOAD_PERIOD){
+        if (payload.probe){  // Path MTU might have changed.
+            payload.max = payload_mtu();
+        }
+        if (payload.lost * 100 > payload.packages * PAYLOAD_LOSS_HIGH){
+            payload.current = payload.current / 2 > PAYLOAD_MIN ? payload.current / 2 : PAYLOAD_MIN;
+        }
+        else if (payload.lost * 100 <= payload.packages * PAYLOAD_LOSS_LOW){
+            payload.current = payload.current * 2;
+        }
+        payload.current = payload.current < payload.max ? payload.current : payload.max;
+        payload.packages = 0;
+        payload.lost = 0;
+    }
+    return len < payload.current ? len : payload.current;
+}
+
+
 // Creates server_address.
 static struct sockaddr_in get_server_address(char const *host, uint16_t port, bool* error, int fam, int sock, int prot) {
     // Creating hints.
@@ -57,28 +301,22 @@ static struct sockaddr_in get_server_address(char const *host, uint16_t port, bo
 
 
 // Sends one package to server using UDP protocol.
-int send_udp_pack(int socket_fd, int id, void *pack, size_t size, struct sockaddr_in server_address, char* msg, uint32_t msg_size, uint64_t pack_id){
+// Package is gathered from its header and part of 'msg' without copying the data.
+int send_udp_pack(int socket_fd, int id, void *pack, size_t size, struct sockaddr_in server_address, char* msg, uint32_t msg_size){
     int code = 0;  // Return code.
-    void* buffer;
-    if (msg == NULL){  // No message, only package.
-        buffer = malloc(size + sizeof(uint8_t));  // Buffer with package and message.
-    }
-    else{
-        buffer = malloc(size + msg_size + sizeof(uint8_t));
-    }
-    if (malloc_error(buffer) == 1){
-        return -1;
-    }
-    memcpy(buffer, &id, sizeof(uint8_t));
-    memcpy(buffer + sizeof(uint8_t), pack, size);
-    // Sending some part of message.
-    if (msg != NULL){
-        memcpy(buffer + sizeof(uint8_t) + size, msg + MAX_MSG * pack_id, msg_size);
-    }
+    uint8_t pack_type = id;
+    struct iovec parts[3] = {
+        {.iov_base = &pack_type, .iov_len = sizeof(uint8_t)},
+        {.iov_base = pack, .iov_len = size},
+        {.iov_base = msg, .iov_len = msg_size},  // Sending some part of message.
+    };
+    struct msghdr message = {.msg_name = &server_address, .msg_namelen = sizeof(server_address),
+                             .msg_iov = parts, .msg_iovlen = msg == NULL ? 2 : 3};
 
-    // Sending buffer to server.
-    ssize_t sent_length = sendto(socket_fd, buffer, sizeof(uint8_t) + size + msg_size, 0,
-                                 (struct sockaddr *) &server_address, sizeof(server_address));
+    // Sending package to server.
+    ssize_t sent_length = sendmsg(socket_fd, &message, 0);
+    sent.packages++;
+    sent.syscalls++;
 
     if (sent_length < 0) {  // Couldn't send.
         code = 1;
@@ -86,17 +324,41 @@ int send_udp_pack(int socket_fd, int id, void *pack, size_t size, struct sockadd
     else if ((size_t) sent_length != sizeof(uint8_t) + size + msg_size) {  // Couldn't send fully
         fprintf(stderr, "ERROR: Package was sent incompletely.\n");
     }
-    free(buffer);
     return code;
 }
 
 
-// Receives package using UDP protocol.
-int recv_udp_prot(int socket_fd, uint64_t sess_id){
-    static char back[sizeof(data_msg)];
+// Waits until a package can be received, but not after 'deadline' (us).
+// Returns 1 if the package came, 0 on timeout and -1 on error.
+static int wait_package(int socket_fd, uint64_t deadline){
+    for (;;){
+        uint64_t now = mono_us();
+        uint64_t left = deadline > now ? deadline - now : 0;
+        struct timespec timeout = {.tv_sec = left / 1000000, .tv_nsec = (left % 1000000) * 1000};
+        struct pollfd wait_fd = {.fd = socket_fd, .events = POLLIN};
+        int ready = ppoll(&wait_fd, 1, &timeout, NULL);  // Timeouts may be shorter than a millisecond.
+        if (ready < 0 && errno == EINTR){
+            continue;
+        }
+        if (ready < 0){
+            fprintf(stderr, "ERROR: Couldn't wait for messages.\n");
+        }
+        return ready < 0 ? -1 : ready;
+    }
+}
+
+
+// Receives package using UDP protocol, waits until 'deadline' (us).
+// Capabilities which came after CONNACC are read into 'caps', offset to resume at after them.
+int recv_udp_prot(int socket_fd, uint64_t sess_id, uint64_t deadline, capabilities *caps){
+    int ready = wait_package(socket_fd, deadline);
+    if (ready <= 0){
+        return ready == 0 ? -4 : -2;
+    }
+    static char back[sizeof(uint8_t) + sizeof(base) + CAPS_SIZE + sizeof(uint64_t)];
     struct sockaddr_in receive_address;
     socklen_t address_length = (socklen_t) sizeof(receive_address);
-    ssize_t received_length = recvfrom(socket_fd, back, sizeof(data_msg), 0,
+    ssize_t received_length = recvfrom(socket_fd, back, sizeof(back), 0,
                                        (struct sockaddr *) &receive_address, &address_length);
     uint8_t id;
     uint64_t sess;
@@ -115,12 +377,33 @@ int recv_udp_prot(int socket_fd, uint64_t sess_id){
         fprintf(stderr, "ERROR: Received message has wrong session ID\n");
         return -3;
     }
+    size_t head = sizeof(uint8_t) + sizeof(base);
+    if (id == 2 && (size_t) received_length > head){
+        size_t size = capabilities_size(back + head, received_length - head);
+        if (size > received_length - head){
+            fprintf(stderr, "ERROR: Received message is incomplete.\n");
+            return -2;
+        }
+        read_capabilities(back + head, caps);
+        if (caps->resume != 0 && size + sizeof(uint64_t) > received_length - head){
+            fprintf(stderr, "ERROR: Received message is incomplete.\n");
+            return -2;
+        }
+        if (caps->resume != 0){
+            memcpy(&resume.offset, back + head + size, sizeof(uint64_t));
+            resume.offset = be64toh(resume.offset);
+        }
+    }
     return id;
 }
 
 
-// Receives ACC. Sets past accepts ID's to '2'.
-int recv_ACC(int socket_fd, uint64_t sess_id, uint64_t pack_id){
+// Receives ACC, waits until 'deadline' (us). Sets past accepts ID's to '2'.
+int recv_ACC(int socket_fd, uint64_t sess_id, uint64_t pack_id, uint64_t deadline){
+    int ready = wait_package(socket_fd, deadline);
+    if (ready <= 0){
+        return ready == 0 ? -4 : -2;
+    }
     static char back[sizeof(data_msg)];  // Allocating space for new package.
     struct sockaddr_in receive_address;
     socklen_t address_length = (socklen_t) sizeof(receive_address);
@@ -153,24 +436,46 @@ int recv_ACC(int socket_fd, uint64_t sess_id, uint64_t pack_id){
             return -1;
         }
     }
+    else if (id == 10 && (size_t) received_length >= sizeof(uint8_t) + sizeof(status)){  // DONE of messages.
+        messages_done(back + sizeof(uint8_t));
+    }
+    else if (id == 11){  // PART, the range is written, it is handled as RCVD.
+        stripe.part = true;
+        return 7;
+    }
     return id;
 }
 
 
-//  Tries to receive ACC.
-int get_ACC(int socket_fd, uint64_t sess_id, uint64_t pack_id, uint32_t byte_len, data_msg *data, struct sockaddr_in server_address, char* msg){
-    int back_id = recv_ACC(socket_fd, sess_id, pack_id);
+//  Tries to receive ACC of the package sent at 'sent_at' (us).
+//  Package is sent again when the retransmission timeout from measured round trip time passes.
+//  Returns 0 on ACC, 1 on error and 2 if RCVD overtook ACC of the last package.
+int get_ACC(int socket_fd, uint64_t sess_id, uint64_t pack_id, uint32_t byte_len, data_msg *data, struct sockaddr_in server_address, char* msg,
+            uint64_t sent_at){
+    int back_id = recv_ACC(socket_fd, sess_id, pack_id, sent_at + timer.rto);
     uint64_t trial = 0;
-    while ((back_id == -4 || back_id == 2) && trial < MAX_RETRANSMITS){  // While receives past accepts or timeouts.
+    // While receives past accepts, DONEs or timeouts.
+    while ((back_id == -4 || back_id == 2 || back_id == 10) && !rtt_expired(&timer, mono_us())){
+        if (back_id == 2){  // Earlier package confirmed again, server holds this one back until it has room.
+            rtt_progress(&timer, mono_us());
+        }
         if (back_id == -4){  // Timeout.
             trial++;
+            rtt_backoff(&timer);
             // Retransmits.
-            if (send_udp_pack(socket_fd, 4, data, sizeof(data_msg), server_address, msg, byte_len, pack_id) == 1){
+            sent_at = mono_us();
+            if (send_udp_pack(socket_fd, 4, data, sizeof(data_msg), server_address, msg, byte_len) == 1){
                 return 1;
             }
         }
         // Tries to receive ACC again.
-        back_id = recv_ACC(socket_fd, sess_id, pack_id);
+        back_id = recv_ACC(socket_fd, sess_id, pack_id, sent_at + timer.rto);
+    }
+    if (back_id == 5 && trial == 0){  // ACC answers the only transmission, so it measures round trip time.
+        rtt_sample(&timer, mono_us() - sent_at, mono_us());
+    }
+    else if (back_id == 5){
+        rtt_progress(&timer, mono_us());
     }
     if (back_id == -4){  // Too many timeouts.
         fprintf(stderr, "ERROR: Too many message timeouts.\n");
@@ -180,6 +485,9 @@ int get_ACC(int socket_fd, uint64_t sess_id, uint64_t pack_id, uint32_t byte_len
         fprintf(stderr, "ERROR: Received message is incorrect.\n");
         return 1;
     }
+    else if (back_id == 7){  // Server has the whole message.
+        return 2;
+    }
     else if (back_id != 5){  // Correct package, but not ACC.
         fprintf(stderr, "ERROR: Received message has wrong package ID.\n");
         return 1;
@@ -188,257 +496,1566 @@ int get_ACC(int socket_fd, uint64_t sess_id, uint64_t pack_id, uint32_t byte_len
 }
 
 
-// Sends packages of data to server using UDP protocol.
-int udp_conn(char* msg, uint64_t len, int socket_fd, struct sockaddr_in server_address, uint64_t sess_id, bool udpr){
-    // Creating 'CONN' package.
-    conn pack;
-    if (udpr){
-        create_conn(&pack, sess_id, 3, len);  // CONN UDPR.
-    }
-    else{
-        create_conn(&pack, sess_id, 2, len);  // CONN UDP.
-    }
+// DATA and PARITY packages sent with one syscall.
+// With GSO consecutive packages of the same size share one message and the kernel
+// splits it into datagrams, so the whole path below the socket is taken once per message.
+typedef struct send_batch{
+    struct mmsghdr *headers; // Messages, each of one package or of 'segments' packages with GSO.
+    struct iovec *iovecs;    // Header and data of every package.
+    char *packs;             // Headers of packages, 'SEND_HEADER' bytes each.
+    char *controls;          // UDP_SEGMENT control message of every message.
+    uint32_t *segments;      // Packages in every message.
+    size_t count;            // Packages in the batch.
+    size_t messages;         // Messages in the batch.
+    size_t size;             // Max number of packages.
+    size_t bytes;            // Size of the last message.
+    bool closed;             // Last message ends with a shorter package, nothing may follow it.
+    bool gso;                // Kernel splits messages, turned off when it can't.
+    struct sockaddr_in address;
+} send_batch;
 
-    // Sending 'CONN' package.
-    if (send_udp_pack(socket_fd,1, &pack, sizeof(conn), server_address, NULL, 0, 0) == 1) {
+
+#define SEND_HEADER (sizeof(uint8_t) + sizeof(parity_msg))  // PARITY has the longest header.
+#define SEND_CONTROL CMSG_SPACE(sizeof(uint16_t))
+
+
+// Allocates batch of up to 'size' packages sent to 'address', with 'gso' if the socket supports it.
+static int send_batch_init(send_batch *batch, size_t size, struct sockaddr_in address, int socket_fd, bool gso){
+    batch->headers = calloc(size, sizeof(struct mmsghdr));
+    batch->iovecs = calloc(2 * size, sizeof(struct iovec));
+    batch->packs = malloc(size * SEND_HEADER);
+    batch->controls = calloc(size, SEND_CONTROL);
+    batch->segments = malloc(size * sizeof(uint32_t));
+    if (malloc_error(batch->headers) == 1 || malloc_error(batch->iovecs) == 1 || malloc_error(batch->packs) == 1 ||
+        malloc_error(batch->controls) == 1 || malloc_error(batch->segments) == 1){
+        free(batch->headers);
+        free(batch->iovecs);
+        free(batch->packs);
+        free(batch->controls);
+        free(batch->segments);
         return 1;
     }
+    batch->count = 0;
+    batch->messages = 0;
+    batch->size = size;
+    batch->address = address;
+    // Kernels without GSO reject the option, packages are then sent one per message.
+    batch->gso = gso && setsockopt(socket_fd, SOL_UDP, UDP_SEGMENT, &(int){0}, sizeof(int)) == 0;
+    return 0;
+}
 
-    // Receive a message.
-    uint64_t trial = 0;
-    int back_id = recv_udp_prot(socket_fd, sess_id);
 
-    // Retransmissions.
-    while (back_id == -4 && udpr && trial < MAX_RETRANSMITS){
-        if (send_udp_pack(socket_fd, 1, &pack, sizeof(conn), server_address, NULL, 0, 0) == 1) {
-            return 1;
-        }
-        back_id = recv_udp_prot(socket_fd, sess_id);
-        trial++;
-    }
+// Frees batch memory.
+static void send_batch_free(send_batch *batch){
+    free(batch->headers);
+    free(batch->iovecs);
+    free(batch->packs);
+    free(batch->controls);
+    free(batch->segments);
+}
 
-    if (back_id == 3){  // Received 'CONRJT'.
-        fprintf(stderr, "ERROR: Couldn't connect with the server.\n");
-        return 1;
+
+// Sets message 'index' to the single package 'pack'.
+static void send_batch_single(send_batch *batch, size_t index, size_t pack){
+    batch->headers[index].msg_hdr = (struct msghdr) {.msg_name = &batch->address, .msg_namelen = sizeof(batch->address),
+                                                     .msg_iov = &batch->iovecs[2 * pack], .msg_iovlen = 2};
+    batch->segments[index] = 1;
+}
+
+
+// Sends packages of messages from 'done' on one per message, GSO is turned off.
+static void send_batch_split(send_batch *batch, size_t done){
+    size_t pack = 0;  // First package of message 'done'.
+    for (size_t i = 0; i < done; i++){
+        pack += batch->segments[i];
     }
-    else if (back_id == 2){  // Received 'CONACC'.
-        uint64_t pack_id = 0;
-        while (len != 0){  // Sending 'DATA" packages.
-            data_msg data_pack;
-            uint32_t byte_len = min_msg(len);
-            create_data(&data_pack, sess_id, pack_id, byte_len);
-            // Tries sending part of the message.
-            if (send_udp_pack(socket_fd, 4, &data_pack, sizeof(data_msg), server_address, msg, byte_len, pack_id) == 1){
-                return 1;
-            }
-            // Retransmissions.
-            if (udpr && get_ACC(socket_fd, sess_id, pack_id, byte_len, &data_pack, server_address, msg) == 1){
-                return 1;
-            }
-            len -= byte_len;
-            pack_id++;
+    batch->messages = done;
+    for (; pack < batch->count; pack++){
+        send_batch_single(batch, batch->messages, pack);
+        batch->messages++;
+    }
+    batch->gso = false;
+}
+
 
+// Sends all packages of the batch.
+static int send_batch_flush(send_batch *batch, int socket_fd){
+    size_t done = 0;
+    while (done < batch->messages){  // Kernel may take only a part of the batch.
+        int sent_count = sendmmsg(socket_fd, batch->headers + done, batch->messages - done, 0);
+        sent.syscalls++;
+        // Device can't segment, or segments don't fit the path. Packages are sent one by one from now on.
+        if (sent_count < 0 && batch->segments[done] > 1 && (errno == EIO || errno == EINVAL || errno == EMSGSIZE)){
+            send_batch_split(batch, done);
+            continue;
         }
-        int recv;
-        do{
-            recv = recv_ACC(socket_fd, sess_id, pack_id);
-        } while (recv == 2 && udpr);  // Receiving past accepts.
-        if (recv == -4){
-            fprintf(stderr, "ERROR: Message timeout. Didn't get RECV.\n");
+        if (sent_count < 0){
+            fprintf(stderr, "ERROR: Couldn't send message.\n");
             return 1;
         }
-        else if (recv != 7){  // Waiting for 'RCVD' after sending all 'DATA'.
-            fprintf(stderr, "ERROR: Didn't get RECV.\n");
-            return 1;
+        for (int i = 0; i < sent_count; i++){
+            sent.packages += batch->segments[done + i];
         }
+        done += sent_count;
     }
-    else if (back_id == -4){
-        fprintf(stderr, "ERROR: Message timeout.\n");
-        return 1;
+    batch->count = 0;
+    batch->messages = 0;
+    return 0;
+}
+
+
+// Adds package with header 'pack' of 'size' bytes to the batch, its data is sent from where it is.
+// With GSO the package joins the last message if it isn't larger than its first package. Full batch is sent.
+static int send_batch_push(send_batch *batch, int socket_fd, uint8_t id, void const *pack, size_t size, char *data, uint32_t byte_len){
+    size_t count = batch->count;
+    char *head = batch->packs + count * SEND_HEADER;
+    memcpy(head, &id, sizeof(uint8_t));
+    memcpy(head + sizeof(uint8_t), pack, size);
+    batch->iovecs[2 * count] = (struct iovec) {.iov_base = head, .iov_len = sizeof(uint8_t) + size};
+    batch->iovecs[2 * count + 1] = (struct iovec) {.iov_base = data, .iov_len = byte_len};
+    size_t bytes = sizeof(uint8_t) + size + byte_len;
+    struct msghdr *last = batch->messages > 0 ? &batch->headers[batch->messages - 1].msg_hdr : NULL;
+    size_t segment = last != NULL ? last->msg_iov[0].iov_len + last->msg_iov[1].iov_len : 0;
+    if (batch->gso && last != NULL && !batch->closed && bytes <= segment &&
+        batch->segments[batch->messages - 1] < GSO_SEGMENTS && batch->bytes + bytes <= GSO_BYTES){
+        // Segments follow each other in 'iovecs', the last one may be shorter.
+        if (batch->segments[batch->messages - 1] == 1){
+            last->msg_control = batch->controls + (batch->messages - 1) * SEND_CONTROL;
+            last->msg_controllen = SEND_CONTROL;
+            struct cmsghdr *control = CMSG_FIRSTHDR(last);
+            control->cmsg_level = SOL_UDP;
+            control->cmsg_type = UDP_SEGMENT;
+            control->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+            uint16_t gso_size = segment;
+            memcpy(CMSG_DATA(control), &gso_size, sizeof(uint16_t));
+        }
+        last->msg_iovlen += 2;
+        batch->segments[batch->messages - 1]++;
+        batch->bytes += bytes;
+        batch->closed = bytes < segment;
     }
-    else if (back_id >= 0){  //  Received other code.
-        fprintf(stderr, "ERROR: Received message has wrong package ID.\n");
-        return 1;
+    else{
+        send_batch_single(batch, batch->messages, count);
+        batch->messages++;
+        batch->bytes = bytes;
+        batch->closed = false;
     }
-    else{  // Error while receiving the message.
-        fprintf(stderr, "ERROR: Received message is incorrect.\n");
-        return 1;
+    batch->count++;
+    if (batch->count == batch->size){
+        return send_batch_flush(batch, socket_fd);
     }
     return 0;
 }
 
 
-// Reads and validates new protocol. Returns ID of validated protocol.
-int tcp_read_prot(int socket_fd, uint64_t sess_id){
-    static char pack[sizeof(uint8_t) + sizeof(base)];
-    if (tcp_read(socket_fd, pack, sizeof(uint8_t) + sizeof(base)) == 1){
-        return -1;
-    }
-    uint64_t session;
-    uint8_t id;
-    memcpy(&id, pack, sizeof(uint8_t));
-    memcpy(&session, pack + sizeof(uint8_t), sizeof(uint64_t));
-    if (sess_id != session) {  // Checking session ID.
-        fprintf(stderr, "ERROR: Message with wrong session ID\n");
-        return -1;
-    }
-    return id;
+// Adds DATA package to the batch. Full batch is sent.
+static int send_batch_add(send_batch *batch, int socket_fd, uint64_t sess_id, uint64_t pack_id, char *data, uint32_t byte_len){
+    data_msg data_pack;
+    create_data(&data_pack, sess_id, pack_id, byte_len);
+    return send_batch_push(batch, socket_fd, 4, &data_pack, sizeof(data_msg), data, byte_len);
 }
 
 
-// Sends packages of data using TCP protocol.
-int tcp_conn(char *msg, uint64_t len, int socket_fd, uint64_t sess_id){
-    static char data[sizeof(uint8_t) + sizeof(conn)];
-    uint8_t id = 1;
-    conn pack;
-    create_conn(&pack, sess_id, 1, len);  // CONN.
-    memcpy(data, &id, sizeof(uint8_t));
-    memcpy(data + sizeof(uint8_t), &pack, sizeof(conn));
-    if (tcp_write(socket_fd, data, sizeof(uint8_t) + sizeof(conn)) == 1){  // Sending CONN.
-        fprintf(stderr, "ERROR: Couldn't send message.\n");
-        return 1;
-    }
-    int read = tcp_read_prot(socket_fd, sess_id);  // Receiving CONNACC.
-    if (read == -1){  // Message receive problem.
-        return 1;
+// Adds PARITY of the block to the batch. Full batch is sent.
+static int send_batch_parity(send_batch *batch, int socket_fd, uint64_t sess_id, fec_block const *block, char *parity){
+    parity_msg parity_pack;
+    create_parity(&parity_pack, sess_id, block->first, block->count, block->len_xor, block->byte_len);
+    return send_batch_push(batch, socket_fd, 9, &parity_pack, sizeof(parity_msg), parity, block->byte_len);
+}
+
+
+// Pauses between batches, so receiver can drain its buffer.
+static void send_gap(client_config const *config){
+    if (config->gap > 0){
+        struct timespec gap = {.tv_sec = config->gap / 1000000, .tv_nsec = (config->gap % 1000000) * 1000};
+        nanosleep(&gap, NULL);
     }
-    else if (read != 2){  // Received ID doesn't match CONACC.
-        fprintf(stderr, "ERROR: Wrong package ID, didn't receive CONNACC.\n");
+}
+
+
+// Sends all DATA packages without waiting for confirmations, up to 'batch' packages with one syscall.
+// Headers are built for the whole batch, data is sent straight from 'msg'.
+// In stream mode data is read from stdin into 'batch' chunks reused by every batch,
+// the last package is empty. First package gets ID 'pack_id', which is set to the ID after the last one.
+// With FEC every 'FEC_BLOCK' packages and the last ones are followed by their PARITY.
+// Parity buffers are reused once a batch later, when their PARITY is surely sent.
+// With rate limit the batch is sent early when the next package has to wait.
+int udp_send_all(char* msg, uint64_t len, int socket_fd, struct sockaddr_in server_address, uint64_t sess_id,
+                 uint64_t *pack_id, client_config const *config){
+    send_batch batch;
+    if (send_batch_init(&batch, config->batch, server_address, socket_fd, config->gso) == 1){
         return 1;
     }
-
-    id = 4;
-    data_msg data_pack;  // DATA.
-    uint32_t max_size = min_msg(len);
-    void* buffer = malloc(sizeof(uint8_t) + sizeof(data_msg) + max_size);  // DATA + message.
-    if (malloc_error(buffer) == 1){
+    size_t parities = config->batch / FEC_BLOCK + 1;  // Max number of PARITY packages in one batch.
+    char *chunks = config->stream ? malloc(config->batch * MAX_MSG) : NULL;
+    char *parity = config->fec ? malloc(parities * MAX_MSG) : NULL;
+    if ((config->stream && malloc_error(chunks) == 1) || (config->fec && malloc_error(parity) == 1)){
+        send_batch_free(&batch);
+        free(chunks);
+        free(parity);
         return 1;
     }
-    uint64_t pack_id = 0;
-    while (len != 0){  // Sending whole package in portions
-        uint32_t byte_len = min_msg(len);
-        create_data(&data_pack, sess_id, pack_id, byte_len);     // Creating new package of data.
-        memset(buffer,0, sizeof(uint8_t) + sizeof(data_msg) + max_size);
-        memcpy(buffer, &id, sizeof(uint8_t));
-        memcpy(buffer + sizeof(uint8_t), &data_pack, sizeof(data_msg));       // Copying new package to buffer.
-        memcpy(buffer + sizeof(uint8_t) + sizeof(data_msg), msg + pack_id * MAX_MSG, byte_len);  // Copying message to buffer.
-        if (tcp_write(socket_fd, buffer, sizeof(uint8_t) + sizeof(data_msg) + byte_len) == 1){      // Sending DATA + message.
-            fprintf(stderr, "ERROR: Couldn't send message.\n");
-            free(buffer);
-            return 1;
+    fec_block block;      // Packages since the last PARITY.
+    size_t parity_slot = 0;
+    fec_reset(&block, *pack_id);
+    uint64_t offset = 0;  // Position of the next data in 'msg'.
+    bool more = true;     // Some data is left to send.
+    int code = 0;
+    while (more && code == 0){  // Building batches of 'DATA' packages.
+        // Batch is sent before the next stream chunk is read, the chunk takes the first free place.
+        uint64_t now = mono_us();
+        if (!cc_ready(&control, now)){  // Paced.
+            code = send_batch_flush(&batch, socket_fd);
+            struct timespec pause = {.tv_sec = (control.next_send - now) / 1000000, .tv_nsec = (control.next_send - now) % 1000000 * 1000};
+            nanosleep(&pause, NULL);
+        }
+        char *data = msg + offset;
+        uint32_t byte_len;
+        if (config->stream){
+            data = chunks + batch.count * MAX_MSG;
+            ssize_t got = read_chunk(data, payload_next(MAX_MSG));
+            if (got < 0){
+                code = 1;
+                break;
+            }
+            byte_len = got;
+            more = byte_len != 0;  // Empty package ends the stream.
+        }
+        else{
+            byte_len = payload_next(len);
+            len -= byte_len;
+            offset += byte_len;
+            more = len != 0;
+        }
+        cc_sent(&control, byte_len, mono_us());
+        code = code == 0 ? send_batch_add(&batch, socket_fd, sess_id, *pack_id, data, byte_len) : code;
+        (*pack_id)++;
+        if (config->fec && code == 0){
+            char *current = parity + parity_slot * MAX_MSG;
+            fec_add(&block, current, data, byte_len);
+            if (block.count == FEC_BLOCK || !more){  // Block is complete.
+                code = send_batch_parity(&batch, socket_fd, sess_id, &block, current);
+                parity_slot = (parity_slot + 1) % parities;
+                fec_reset(&block, *pack_id);
+            }
+        }
+        if (batch.count == 0 && more){  // Batch was sent.
+            send_gap(config);
         }
-        len -= byte_len;        // Bytes sent.
-        pack_id++;              // Next pack.
-    }
-    free(buffer);
-    read = tcp_read_prot(socket_fd, sess_id);  // Read RCVD.
-    if (read == -1){  // Message receive problem.
-        return 1;
     }
-    else if (read != 7){  // Received ID doesn't match RCVD.
-        fprintf(stderr, "ERROR: Wrong package ID, didn't receive RCVD.\n");
-        return 1;
+    if (code == 0){
+        code = send_batch_flush(&batch, socket_fd);
     }
-    return 0;
+    send_batch_free(&batch);
+    free(chunks);
+    free(parity);
+    return code;
 }
 
 
-// Reads stdin data. If successful sends data to server using established protocol.
-// Function demands 3 arguments, communication protocol, server id and port id.
-int main(int argc, char *argv[]) {
-    if (argc != 4) {  // Checks for 3 arguments.
-        fprintf(stderr, "ERROR: Expected arguments: %s <communication protocol> <server id> <port>\n", argv[0]);
-        return 1;
+// Sends one DATA package of the window.
+static int window_send(int socket_fd, struct sockaddr_in server_address, uint64_t sess_id, uint64_t pack_id, window_slot *slot){
+    data_msg data_pack;
+    create_data(&data_pack, sess_id, pack_id, slot->byte_len);
+    slot->sent_at = mono_us();
+    return send_udp_pack(socket_fd, 4, &data_pack, sizeof(data_msg), server_address, slot->data, slot->byte_len);
+}
+
+
+// Marks package as confirmed. Keeps the shortest round trip time of packages sent once in 'sample'.
+static int window_confirm(window_slot *slot, uint64_t now, uint64_t *sample){
+    if (slot->acked){
+        return 0;
     }
-    char const *protocol = argv[1];  // Communication protocol.
-    char const *host = argv[2];  // Server id.
-    bool error = false;
-    uint16_t port = read_port(argv[3], &error);
-    if (error){  // There was an error getting port.
-        return 1;
+    slot->acked = true;
+    if (!slot->resent && now - slot->sent_at < *sample){
+        *sample = now - slot->sent_at;
     }
+    return 1;
+}
 
-    char* msg = NULL;  // Whole message.
-    size_t size = 0;
-    // Tries to read message.
-    long long code = getdelim(&msg, &size, EOF, stdin);
-    if (code == -1) {  // Error while reading message.
-        free(msg);
-        fprintf(stderr, "ERROR: Couldn't read message.\n");
-        return 1;
+
+// Marks packages confirmed by windowed ACC and moves 'first' past confirmed ones.
+// Packages missing while 3 ACCs confirmed later ones are sent again once, before their timeout.
+// Returns 1 if ACC confirmed anything new, 0 if not and -1 if it is incorrect.
+static int window_ack_handle(window_ack const *ack, window_slot *slots, size_t window, uint64_t *first, uint64_t next,
+                             int socket_fd, struct sockaddr_in server_address, uint64_t sess_id){
+    uint64_t received = be64toh(ack->pack_id);  // All packages before it are received.
+    uint64_t mask = be64toh(ack->mask);
+    if (received > next){
+        return -1;
     }
-    if (code == 0){  // Empty message.
-        free(msg);
-        fprintf(stderr, "ERROR: Empty message won't be send.\n");
-        return 1;
+    uint64_t acked = 0;  // Newly confirmed packages.
+    uint64_t now = mono_us();
+    uint64_t sample = UINT64_MAX;  // Round trip time of the latest package confirmed by this ACC.
+    for (uint64_t pack_id = *first; pack_id < received; pack_id++){
+        acked += window_confirm(&slots[pack_id % window], now, &sample);
     }
-
-    uint64_t sess_id = gen_sess_id();  // Generating session id.
-    int sock, prot;  // Protocol settings.
-    if (strcmp(protocol, "tcp") == 0){  // TCP.
-        sock = SOCK_STREAM;
-        prot = IPPROTO_TCP;
+    uint64_t highest = received;  // After the last confirmed package.
+    for (uint64_t i = 0; i < 64 && mask >> i != 0; i++){
+        uint64_t pack_id = received + 1 + i;
+        if (pack_id >= next){
+            break;
+        }
+        if ((mask >> i) & 1){
+            highest = pack_id + 1;
+            if (pack_id >= *first){
+                acked += window_confirm(&slots[pack_id % window], now, &sample);
+            }
+        }
     }
-    else{  // UDP/UDPr.
-        sock = SOCK_DGRAM;
-        prot = IPPROTO_UDP;
+    if (sample != UINT64_MAX){
+        rtt_sample(&timer, sample, now);
     }
-    error = false;
-    struct sockaddr_in server_address = get_server_address(host, port, &error, AF_INET, sock, prot);
-    if (error){  // There was an error getting server address.
-        free(msg);
-        return 1;
+    else{  // Server answers, even if it holds the next package back until it has room.
+        rtt_progress(&timer, now);
     }
-
-    int socket_fd = socket(AF_INET, sock, 0);
-    if (socket_fd < 0) {  // There was an error creating a socket.
-        fprintf(stderr,"ERROR: Couldn't create a socket\n");
-        free(msg);
-        return 1;
+    cc_ack(&control, acked, sample != UINT64_MAX ? sample : 0, timer.srtt, now);
+    while (*first < next && slots[*first % window].acked){
+        (*first)++;
     }
-
-    // Setting timeout on the socket.
-    struct timeval timeout;
-    timeout.tv_sec = MAX_WAIT;
-    timeout.tv_usec = 0;
-    if (setsockopt (socket_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof timeout) < 0){
-        fprintf(stderr, "ERROR: Couldn't set timeout on the socket.\n");
-        return 1;
+    for (uint64_t pack_id = *first; pack_id < highest; pack_id++){  // Holes before confirmed packages.
+        window_slot *slot = &slots[pack_id % window];
+        if (!slot->acked && !slot->resent && ++slot->reports >= 3){
+            cc_loss(&control, pack_id, next, timer.srtt, now);
+            payload.lost++;
+            slot->resent = true;
+            if (window_send(socket_fd, server_address, sess_id, pack_id, slot) == 1){
+                return -1;
+            }
+        }
     }
+    return acked > 0;
+}
 
-    if (strcmp(protocol, "udp") == 0 || strcmp(protocol, "udpr") == 0){  // Sending the message using UDP protocol.
-        bool udpr = false;  // Allows retransmissions.
-        if (strcmp(protocol, "udpr") == 0){
-            udpr = true;
+
+// Receives all waiting packages in windowed mode.
+// Returns 0 if client should send more, 1 on error and 2 if RCVD was received.
+static int window_receive(window_slot *slots, size_t window, uint64_t *first, uint64_t next,
+                          int socket_fd, struct sockaddr_in server_address, uint64_t sess_id){
+    for (;;){
+        char back[sizeof(uint8_t) + sizeof(window_ack)];
+        ssize_t received_length = recv(socket_fd, back, sizeof(back), MSG_DONTWAIT);
+        if (received_length < 0){
+            if (errno == EAGAIN || errno == EWOULDBLOCK){  // Everything was received.
+                return 0;
+            }
+            fprintf(stderr, "ERROR: Couldn't receive message.\n");
+            return 1;
         }
-        // Sending messages to the server.
-        if (udp_conn(msg, code, socket_fd, server_address, sess_id, udpr) == 1){
-            free(msg);
-            close(socket_fd);
+        uint64_t sess;
+        if ((size_t) received_length < sizeof(uint8_t) + sizeof(base)){
+            fprintf(stderr, "ERROR: Received message is incorrect.\n");
             return 1;
         }
-        close(socket_fd);
-    }
-    else if (strcmp(protocol, "tcp") == 0){
-        // Connecting to the server.
-        if (connect(socket_fd, (struct sockaddr *) &server_address, (socklen_t) sizeof(server_address)) < 0) {
-            free(msg);
-            fprintf(stderr, "ERROR: Couldn't connect to the server.");
+        memcpy(&sess, back + sizeof(uint8_t), sizeof(uint64_t));
+        if (sess != sess_id){
+            fprintf(stderr, "ERROR: Received message has wrong session ID\n");
             return 1;
         }
-        // Sending message to the server.
-        if (tcp_conn(msg, code, socket_fd, sess_id) == 1){
-            free(msg);
-            close(socket_fd);
+        if (back[0] == 7 || back[0] == 11){  // RCVD or PART.
+            stripe.part = back[0] == 11;
+            return 2;
+        }
+        else if (back[0] == 10 && (size_t) received_length >= sizeof(uint8_t) + sizeof(status)){  // DONE.
+            messages_done(back + sizeof(uint8_t));
+        }
+        else if (back[0] == 5 && (size_t) received_length == sizeof(back)){  // ACC.
+            int code = window_ack_handle((window_ack const *) (back + sizeof(uint8_t)), slots, window, first, next,
+                                         socket_fd, server_address, sess_id);
+            if (code < 0){
+                fprintf(stderr, "ERROR: Received message is incorrect.\n");
+                return 1;
+            }
+        }
+        else if (back[0] == 6 && (size_t) received_length >= sizeof(uint8_t) + sizeof(status)){  // RJT.
+            uint64_t pack_id;
+            memcpy(&pack_id, back + sizeof(uint8_t) + sizeof(uint64_t), sizeof(uint64_t));
+            pack_id = be64toh(pack_id);
+            // Late retransmissions of confirmed packages are rejected after the server has finished.
+            if (pack_id >= next || (pack_id >= *first && !slots[pack_id % window].acked)){
+                fprintf(stderr, "ERROR: Server rejected package.\n");
+                return 1;
+            }
+        }
+        else if (back[0] != 2){  // Retransmitted CONACC is ignored.
+            fprintf(stderr, "ERROR: Received message has wrong package ID.\n");
+            return 1;
+        }
+    }
+}
+
+
+// Sends message keeping up to 'window' unconfirmed packages in flight, fewer if congestion window is smaller.
+// New packages are paced. Every ACC describes all packages the server has, so only missing packages are sent again.
+// Returns after RCVD is received.
+int udp_window(char *msg, uint64_t len, int socket_fd, struct sockaddr_in server_address, uint64_t sess_id, client_config const *config){
+    size_t window = config->window;
+    window_slot slots[WINDOW];
+    char *chunks = config->stream ? malloc(window * MAX_MSG) : NULL;  // Stream data is kept until confirmed.
+    if (config->stream && malloc_error(chunks) == 1){
+        return 1;
+    }
+    uint64_t first = 0;     // Oldest unconfirmed package.
+    uint64_t next = 0;      // Next package sent for the first time.
+    uint64_t offset = 0;    // Position of the next data in 'msg'.
+    uint64_t idle = 0;      // Time (us) since everything is confirmed.
+    bool more = true;       // Some data is left to send.
+    int code = 0;
+    while (code == 0){
+        while (more && next < first + cc_window(&control, window) && cc_ready(&control, mono_us())){  // Filling the window.
+            window_slot *slot = &slots[next % window];
+            if (config->stream){
+                slot->data = chunks + (next % window) * MAX_MSG;
+                ssize_t got = read_chunk(slot->data, payload_next(MAX_MSG));
+                if (got < 0){
+                    code = 1;
+                    break;
+                }
+                slot->byte_len = got;
+                more = got != 0;  // Empty package ends the stream.
+            }
+            else{
+                slot->data = msg + offset;
+                slot->byte_len = payload_next(len);
+                len -= slot->byte_len;
+                offset += slot->byte_len;
+                more = len != 0;
+            }
+            slot->acked = false;
+            slot->resent = false;
+            slot->reports = 0;
+            if (window_send(socket_fd, server_address, sess_id, next, slot) == 1){
+                code = 1;
+                break;
+            }
+            cc_sent(&control, slot->byte_len, slot->sent_at);
+            next++;
+        }
+        if (code == 1){
+            break;
+        }
+
+        // Waiting for ACC, but not longer than until the oldest transmission times out,
+        // or the next package may be sent.
+        uint64_t oldest = UINT64_MAX;
+        for (uint64_t pack_id = first; pack_id < next; pack_id++){
+            if (!slots[pack_id % window].acked && slots[pack_id % window].sent_at < oldest){
+                oldest = slots[pack_id % window].sent_at;
+            }
+        }
+        if (oldest == UINT64_MAX){  // Everything is confirmed, RCVD is awaited.
+            idle = idle == 0 ? mono_us() : idle;
+            oldest = idle;
+        }
+        uint64_t expiry = oldest + timer.rto;
+        uint64_t deadline = expiry;
+        if (more && next < first + cc_window(&control, window) && control.next_send < deadline){  // Paced.
+            deadline = control.next_send;
+        }
+        int ready = wait_package(socket_fd, deadline);
+        uint64_t now = mono_us();
+        if (ready < 0){
+            code = 1;
+        }
+        else if (ready == 0 && now >= expiry){  // Timeout.
+            if (rtt_expired(&timer, now)){
+                fprintf(stderr, "ERROR: Too many message timeouts.\n");
+                code = 1;
+            }
+            uint64_t rto = timer.rto;
+            rtt_backoff(&timer);
+            cc_timeout(&control, next, timer.srtt, now);
+            idle = 0;
+            for (uint64_t pack_id = first; pack_id < next && code == 0; pack_id++){  // Retransmissions.
+                window_slot *slot = &slots[pack_id % window];
+                if (!slot->acked && slot->sent_at + rto <= now){
+                    slot->resent = true;
+                    payload.lost++;
+                    code = window_send(socket_fd, server_address, sess_id, pack_id, slot);
+                }
+            }
+        }
+        else if (ready > 0){
+            code = window_receive(slots, window, &first, next, socket_fd, server_address, sess_id);
+        }
+    }
+    free(chunks);
+    return code == 2 ? 0 : 1;
+}
+
+
+// Handles NACK. Packages before the first missing one are confirmed, listed ones are sent again,
+// unless they were sent less than a round trip ago. Returns -1 if NACK is incorrect.
+static int nack_handle(char const *pack, size_t size, window_slot *slots, uint64_t *first, uint64_t next,
+                       int socket_fd, struct sockaddr_in server_address, uint64_t sess_id){
+    nack const *head = (nack const *) pack;
+    uint64_t received = be64toh(head->pack_id);  // All packages before it are received.
+    uint64_t highest = be64toh(head->highest);   // No package from it on is received.
+    uint16_t count = be16toh(head->count);
+    if (size < sizeof(nack) + count * sizeof(nack_range) || received > highest || highest > next){
+        return -1;
+    }
+    uint64_t now = mono_us();
+    uint64_t round = timer.srtt > 0 ? timer.srtt : timer.rto;
+    uint64_t sample = UINT64_MAX;  // Round trip time of the latest package confirmed by this NACK.
+    uint64_t acked = 0;            // Newly confirmed packages.
+    for (uint64_t pack_id = *first; pack_id < received; pack_id++){
+        acked += window_confirm(&slots[pack_id % NACK_WINDOW], now, &sample);
+    }
+    uint64_t pack_id = *first > received ? *first : received;  // Late NACK may list confirmed packages.
+    uint64_t end = received;
+    for (uint16_t i = 0; i < count; i++){
+        nack_range const *range = (nack_range const *) (pack + sizeof(nack) + i * sizeof(nack_range));
+        uint64_t missing = be64toh(range->first);
+        if (missing < end || be32toh(range->count) > highest - missing){  // Ranges are ordered and disjoint.
+            return -1;
+        }
+        end = missing + be32toh(range->count);
+        missing = missing > pack_id ? missing : pack_id;
+        for (; pack_id < missing; pack_id++){  // Packages between ranges are received.
+            acked += window_confirm(&slots[pack_id % NACK_WINDOW], now, &sample);
+        }
+        if (missing < end && highest - end >= 3){  // Not just reordered, 3 later packages came.
+            cc_loss(&control, missing, next, timer.srtt, now);
+        }
+        for (; pack_id < end; pack_id++){
+            window_slot *slot = &slots[pack_id % NACK_WINDOW];
+            if (!slot->acked && slot->sent_at + round <= now){
+                slot->resent = true;
+                payload.lost++;
+                if (window_send(socket_fd, server_address, sess_id, pack_id, slot) == 1){
+                    return -1;
+                }
+            }
+        }
+    }
+    if (count < NACK_RANGES){  // List is complete, so everything else up to 'highest' is received.
+        for (; pack_id < highest; pack_id++){
+            acked += window_confirm(&slots[pack_id % NACK_WINDOW], now, &sample);
+        }
+    }
+    if (sample != UINT64_MAX){
+        rtt_sample(&timer, sample, now);
+    }
+    else{  // Server answers, even if it holds the next package back until it has room.
+        rtt_progress(&timer, now);
+    }
+    cc_ack(&control, acked, sample != UINT64_MAX ? sample : 0, timer.srtt, now);
+    while (*first < next && slots[*first % NACK_WINDOW].acked){
+        (*first)++;
+    }
+    return 0;
+}
+
+
+// Receives all waiting packages in NACK mode.
+// Returns 0 if client should send more, 1 on error and 2 if RCVD was received.
+static int nack_receive(window_slot *slots, uint64_t *first, uint64_t next,
+                        int socket_fd, struct sockaddr_in server_address, uint64_t sess_id){
+    for (;;){
+        char back[sizeof(uint8_t) + sizeof(nack) + NACK_RANGES * sizeof(nack_range)];
+        ssize_t received_length = recv(socket_fd, back, sizeof(back), MSG_DONTWAIT);
+        if (received_length < 0){
+            if (errno == EAGAIN || errno == EWOULDBLOCK){  // Everything was received.
+                return 0;
+            }
+            fprintf(stderr, "ERROR: Couldn't receive message.\n");
+            return 1;
+        }
+        uint64_t sess;
+        if ((size_t) received_length < sizeof(uint8_t) + sizeof(base)){
+            fprintf(stderr, "ERROR: Received message is incorrect.\n");
+            return 1;
+        }
+        memcpy(&sess, back + sizeof(uint8_t), sizeof(uint64_t));
+        if (sess != sess_id){
+            fprintf(stderr, "ERROR: Received message has wrong session ID\n");
+            return 1;
+        }
+        if (back[0] == 7 || back[0] == 11){  // RCVD or PART.
+            stripe.part = back[0] == 11;
+            return 2;
+        }
+        else if (back[0] == 10 && (size_t) received_length >= sizeof(uint8_t) + sizeof(status)){  // DONE.
+            messages_done(back + sizeof(uint8_t));
+        }
+        else if (back[0] == 8 && (size_t) received_length >= sizeof(uint8_t) + sizeof(nack)){  // NACK.
+            if (nack_handle(back + sizeof(uint8_t), received_length - sizeof(uint8_t), slots, first, next,
+                            socket_fd, server_address, sess_id) < 0){
+                fprintf(stderr, "ERROR: Received message is incorrect.\n");
+                return 1;
+            }
+        }
+        else if (back[0] == 6 && (size_t) received_length >= sizeof(uint8_t) + sizeof(status)){  // RJT.
+            uint64_t pack_id;
+            memcpy(&pack_id, back + sizeof(uint8_t) + sizeof(uint64_t), sizeof(uint64_t));
+            pack_id = be64toh(pack_id);
+            // Late retransmissions of confirmed packages are rejected after the server has finished.
+            if (pack_id >= next || (pack_id >= *first && !slots[pack_id % NACK_WINDOW].acked)){
+                fprintf(stderr, "ERROR: Server rejected package.\n");
+                return 1;
+            }
+        }
+        else if (back[0] != 2){  // Retransmitted CONACC is ignored.
+            fprintf(stderr, "ERROR: Received message has wrong package ID.\n");
+            return 1;
+        }
+    }
+}
+
+
+// Sends message continuously, up to 'NACK_WINDOW' packages after the oldest unconfirmed one,
+// fewer if congestion window is smaller. New packages are paced.
+// Server lists missing packages in NACKs and only those are sent again.
+// Packages the server doesn't know about are sent again after the retransmission timeout.
+// Returns after RCVD is received.
+int udp_nack(char *msg, uint64_t len, int socket_fd, struct sockaddr_in server_address, uint64_t sess_id, client_config const *config){
+    window_slot *slots = malloc(NACK_WINDOW * sizeof(window_slot));
+    char *chunks = config->stream ? malloc((size_t) NACK_WINDOW * MAX_MSG) : NULL;  // Stream data is kept until confirmed.
+    send_batch batch;
+    if (malloc_error(slots) == 1 || (config->stream && malloc_error(chunks) == 1) ||
+        send_batch_init(&batch, config->batch, server_address, socket_fd, config->gso) == 1){
+        free(slots);
+        free(chunks);
+        return 1;
+    }
+    uint64_t first = 0;     // Oldest unconfirmed package.
+    uint64_t next = 0;      // Next package sent for the first time.
+    uint64_t offset = 0;    // Position of the next data in 'msg'.
+    uint64_t idle = 0;      // Time (us) since everything is confirmed.
+    bool more = true;       // Some data is left to send.
+    int code = 0;
+    while (code == 0){
+        uint64_t now = mono_us();
+        while (more && next < first + cc_window(&control, NACK_WINDOW) && cc_ready(&control, now)){  // New packages, one batch at a time.
+            window_slot *slot = &slots[next % NACK_WINDOW];
+            if (config->stream){
+                slot->data = chunks + (next % NACK_WINDOW) * MAX_MSG;
+                ssize_t got = read_chunk(slot->data, payload_next(MAX_MSG));
+                if (got < 0){
+                    code = 1;
+                    break;
+                }
+                slot->byte_len = got;
+                more = got != 0;  // Empty package ends the stream.
+            }
+            else{
+                slot->data = msg + offset;
+                slot->byte_len = payload_next(len);
+                len -= slot->byte_len;
+                offset += slot->byte_len;
+                more = len != 0;
+            }
+            slot->acked = false;
+            slot->resent = false;
+            slot->sent_at = now;
+            cc_sent(&control, slot->byte_len, now);
+            if (send_batch_add(&batch, socket_fd, sess_id, next, slot->data, slot->byte_len) == 1){
+                code = 1;
+            }
+            next++;
+            if (batch.count == 0){  // Batch was sent, NACKs are checked before the next one.
+                break;
+            }
+        }
+        if (code == 0 && batch.count > 0){
+            code = send_batch_flush(&batch, socket_fd);
+        }
+        if (code == 1){
+            break;
+        }
+        bool open = more && next < first + cc_window(&control, NACK_WINDOW);  // Window isn't full.
+        if (open && cc_ready(&control, mono_us())){  // Sending goes on, only waiting NACKs are handled.
+            send_gap(config);
+            code = nack_receive(slots, &first, next, socket_fd, server_address, sess_id);
+            continue;
+        }
+
+        // Waiting for NACK, but not longer than until the next package may be sent, or the timeout.
+        // Server reports lost packages in NACKs, so the timeout only covers lost NACKs and the last packages.
+        // It runs from the latest unconfirmed transmission or confirmation.
+        uint64_t latest = 0;
+        for (uint64_t pack_id = first; pack_id < next; pack_id++){
+            if (!slots[pack_id % NACK_WINDOW].acked && slots[pack_id % NACK_WINDOW].sent_at > latest){
+                latest = slots[pack_id % NACK_WINDOW].sent_at;
+            }
+        }
+        if (latest == 0){  // Everything is confirmed, RCVD is awaited.
+            idle = idle == 0 ? mono_us() : idle;
+            latest = idle;
+        }
+        latest = latest > timer.progress ? latest : timer.progress;
+        uint64_t expiry = latest + timer.rto;
+        uint64_t deadline = open && control.next_send < expiry ? control.next_send : expiry;
+        int ready = wait_package(socket_fd, deadline);
+        now = mono_us();
+        if (ready < 0){
+            code = 1;
+        }
+        else if (ready == 0 && now >= expiry){  // Timeout.
+            if (rtt_expired(&timer, now)){
+                fprintf(stderr, "ERROR: Too many message timeouts.\n");
+                code = 1;
+            }
+            uint64_t rto = timer.rto;
+            rtt_backoff(&timer);
+            cc_timeout(&control, next, timer.srtt, now);
+            idle = 0;
+            for (uint64_t pack_id = first; pack_id < next && code == 0; pack_id++){  // Retransmissions.
+                window_slot *slot = &slots[pack_id % NACK_WINDOW];
+                if (!slot->acked && slot->sent_at + rto <= now){
+                    slot->resent = true;
+                    payload.lost++;
+                    code = window_send(socket_fd, server_address, sess_id, pack_id, slot);
+                }
+            }
+        }
+        else if (ready > 0){
+            code = nack_receive(slots, &first, next, socket_fd, server_address, sess_id);
+        }
+    }
+    send_batch_free(&batch);
+    free(slots);
+    free(chunks);
+    return code == 2 ? 0 : 1;
+}
+
+
+// Waits until sessions of all stripes are accepted, so the server holds the transfer until its last range comes.
+// Returns 1 if the server doesn't join stripes or another stripe couldn't connect.
+static int stripe_ready(capabilities const *agreed){
+    if (stripe.count == 0){
+        return 0;
+    }
+    if (agreed->stripes != stripe.count){
+        fprintf(stderr, "ERROR: Server doesn't join stripes.\n");
+        return 1;
+    }
+    char byte = 1;
+    ssize_t done = write(stripe.ready, &byte, sizeof(byte));
+    close(stripe.ready);
+    if (done == sizeof(byte)){
+        done = read(stripe.go, &byte, sizeof(byte));
+    }
+    close(stripe.go);
+    if (done != sizeof(byte)){
+        fprintf(stderr, "ERROR: Other stripes couldn't connect.\n");
+        return 1;
+    }
+    return 0;
+}
+
+
+// Offer holds only settings which have defaults, so the transfer can go on with a server which doesn't negotiate.
+// Handshake is then tried once more without capabilities, unless stdin was already read for DATA with CONN.
+static bool offer_optional(client_config const *config){
+    return config->ext && !config->session && stripe.count == 0 && config->resume == 0 && !(config->early && config->stream);
+}
+
+
+// Sends packages of data to server using UDP protocol.
+// 'protocol' is 2 for UDP, 3 for UDPR, 4 for windowed UDPR and 5 for UDP with NACKs.
+// In early mode UDP and UDPR send the first DATA with CONN, without waiting a round trip for CONNACC.
+// Returns 2 if an optional offer wasn't answered and should be tried again without capabilities.
+int udp_conn(char* msg, uint64_t len, int socket_fd, struct sockaddr_in server_address, uint64_t sess_id, uint8_t protocol, client_config const *config){
+    bool udpr = protocol != 2;  // Allows retransmissions.
+    // Creating 'CONN' package, followed by offered capabilities.
+    // In early mode the first 'DATA' follows them in the same datagram.
+    char pack[sizeof(conn) + CAPS_SIZE + sizeof(uint8_t) + sizeof(data_msg)];
+    size_t pack_len = sizeof(conn);
+    uint8_t flags = config->stream ? PROT_STREAM : 0;  // Length of a stream isn't known, it is sent as 0.
+    flags |= config->fec ? PROT_FEC : 0;
+    flags |= config->early ? PROT_EARLY : 0;
+    flags |= config->ext ? PROT_EXT : 0;
+    create_conn((conn *) pack, sess_id, protocol | flags, len);
+    if (config->ext){
+        capabilities offer = {.payload = payload.max, .window = protocol == 4 ? config->window : 0, .timeout = config->timeout,
+                              .messages = config->session, .stripes = stripe.count, .stripe = stripe.index,
+                              .resume = config->resume, .digest = resume.digest};
+        pack_len += write_capabilities(pack + pack_len, &offer);
+    }
+    static char chunk[MAX_MSG];  // Stream is read package by package.
+    char *early = msg;
+    uint32_t early_len = 0;
+    uint64_t pack_id = 0;
+    bool more = true;  // Some data is left to send.
+    if (config->early){  // First package is smaller by the CONN header, so the datagram isn't fragmented.
+        uint32_t room = payload.current - sizeof(uint8_t) - pack_len;
+        if (config->ext && room > PAYLOAD_MIN){  // Sent before the server agrees, any server takes that much.
+            room = PAYLOAD_MIN;
+        }
+        if (config->stream){
+            early = chunk;
+            ssize_t got = read_chunk(chunk, room);
+            if (got < 0){
+                return 1;
+            }
+            early_len = got;
+            more = early_len != 0;  // Empty package ends the stream.
+        }
+        else{
+            early_len = len < room ? len : room;
+            more = len != early_len;
+        }
+        uint8_t id = 4;
+        data_msg data_pack;
+        create_data(&data_pack, sess_id, pack_id, early_len);
+        memcpy(pack + pack_len, &id, sizeof(uint8_t));
+        memcpy(pack + pack_len + sizeof(uint8_t), &data_pack, sizeof(data_msg));
+        pack_len += sizeof(uint8_t) + sizeof(data_msg);
+        pack_id++;
+    }
+
+    // Sending 'CONN' package.
+    uint64_t sent_at = mono_us();
+    rtt_init(&timer, sent_at);
+    if (send_udp_pack(socket_fd, 1, pack, pack_len, server_address, config->early ? early : NULL, early_len) == 1) {
+        return 1;
+    }
+
+    // Receive a message.
+    uint64_t trial = 0;
+    capabilities agreed = {0};  // Server's answer, defaults hold where it is 0.
+    int back_id = recv_udp_prot(socket_fd, sess_id, sent_at + timer.rto, &agreed);
+
+    // Retransmissions. Servers without capabilities drop CONN with them, so an optional offer is given up after MAX_WAIT.
+    bool optional = offer_optional(config);
+    while (back_id == -4 && udpr && !rtt_expired(&timer, mono_us()) && !(optional && mono_us() - timer.progress >= MAX_WAIT * 1000000ULL)){
+        rtt_backoff(&timer);
+        sent_at = mono_us();
+        if (send_udp_pack(socket_fd, 1, pack, pack_len, server_address, config->early ? early : NULL, early_len) == 1) {
+            return 1;
+        }
+        back_id = recv_udp_prot(socket_fd, sess_id, sent_at + timer.rto, &agreed);
+        trial++;
+    }
+    if (back_id == 2 && trial == 0){  // CONACC answers the only CONN, so it measures round trip time.
+        rtt_sample(&timer, mono_us() - sent_at, mono_us());
+    }
+    // If 'CONNACC' was lost, data which came with 'CONN' is confirmed instead.
+    bool answered = back_id == 2;  // Agreed capabilities are known.
+    bool finished = config->early && back_id == 7;  // 'RCVD' was already received.
+    if (config->early && (back_id == 5 || back_id == 7 || back_id == 10)){
+        back_id = 2;
+    }
+
+    if ((back_id == 3 || back_id == -4) && optional){  // Tried again without capabilities.
+        return 2;
+    }
+    if (back_id == 3){  // Received 'CONRJT'.
+        fprintf(stderr, "ERROR: Couldn't connect with the server.\n");
+        return 1;
+    }
+    else if (back_id == 2){  // Received 'CONACC'.
+        if (answered && config->session && agreed.messages == 0){
+            fprintf(stderr, "ERROR: Server doesn't keep sessions.\n");
+            return 1;
+        }
+        if (stripe_ready(&agreed) == 1){  // Striped transfer is never early.
+            return 1;
+        }
+        if (resume.offset > len){  // Resumed transfer is never early either.
+            fprintf(stderr, "ERROR: Server resumes past the end of the message.\n");
+            return 1;
+        }
+        msg += resume.offset;
+        len -= resume.offset;
+        more = more && (config->stream || len != 0);
+        client_config settings = *config;  // Agreed capabilities replace the settings.
+        settings.window = agreed.window != 0 ? agreed.window : settings.window;
+        settings.timeout = agreed.timeout != 0 ? agreed.timeout : settings.timeout;
+        if (agreed.payload != 0){
+            payload_agreed(agreed.payload);
+        }
+        config = &settings;
+        uint64_t total = len;
+        uint64_t offset = early_len;  // Position of the next data in 'msg'.
+        len -= config->stream ? 0 : early_len;
+        sent.start = mono_us();
+        // Only windowed and NACK senders get feedback to drive the window, plain UDP is paced by '--rate' alone.
+        cc_init(&control, protocol == 4 || protocol == 5 ? config->cc : NULL, config->rate, config->trace, timer.srtt,
+                sent.start);
+        if (!udpr && more){  // Sending all 'DATA' packages at once, unless whole message went with 'CONN'.
+            if (udp_send_all(msg + offset, len, socket_fd, server_address, sess_id, &pack_id, config) == 1){
+                return 1;
+            }
+            more = false;
+        }
+        else if (protocol == 4 && more){  // Sending window of 'DATA' packages, until 'RCVD'.
+            if (udp_window(msg, len, socket_fd, server_address, sess_id, config) == 1){
+                return 1;
+            }
+            more = false;
+            finished = true;
+        }
+        else if (protocol == 5 && more){  // Sending all 'DATA' packages, missing ones again until 'RCVD'.
+            if (udp_nack(msg, len, socket_fd, server_address, sess_id, config) == 1){
+                return 1;
+            }
+            more = false;
+            finished = true;
+        }
+        // Sending 'DATA" packages. One package is in flight at a time, so they take the most the server
+        // allows; path MTU and loss size only the pipelined senders.
+        while (more){
+            data_msg data_pack;
+            char *data = msg + offset;
+            uint32_t byte_len;
+            if (config->stream){
+                data = chunk;
+                ssize_t got = read_chunk(chunk, payload.limit);
+                if (got < 0){
+                    return 1;
+                }
+                byte_len = got;
+                more = byte_len != 0;  // Empty package ends the stream.
+            }
+            else{
+                byte_len = min_msg(len);
+                len -= byte_len;
+                offset += byte_len;
+                more = len != 0;
+            }
+            create_data(&data_pack, sess_id, pack_id, byte_len);
+            // Tries sending part of the message.
+            sent_at = mono_us();
+            if (send_udp_pack(socket_fd, 4, &data_pack, sizeof(data_msg), server_address, data, byte_len) == 1){
+                return 1;
+            }
+            // Retransmissions.
+            int acked = udpr ? get_ACC(socket_fd, sess_id, pack_id, byte_len, &data_pack, server_address, data, sent_at) : 0;
+            if (acked == 1){
+                return 1;
+            }
+            finished = acked == 2;
+            more = more && !finished;
+            pack_id++;
+        }
+        int recv = 7;
+        uint64_t deadline = mono_us() + config->timeout * 1000ULL;
+        // Receiving past accepts and DONEs.
+        while (!finished && (((recv = recv_ACC(socket_fd, sess_id, pack_id, deadline)) == 2 && udpr) || recv == 10));
+        if (recv == -4){
+            fprintf(stderr, "ERROR: Message timeout. Didn't get RECV.\n");
+            return 1;
+        }
+        else if (recv != 7){  // Waiting for 'RCVD' after sending all 'DATA'.
+            fprintf(stderr, "ERROR: Didn't get RECV.\n");
+            return 1;
+        }
+        if (config->stats){
+            double seconds = (mono_us() - sent.start) / 1e6;
+            total = config->stream ? sent.streamed : total;
+            fprintf(stderr, "STATS: %" PRIu64 " packages, %" PRIu64 " syscalls, %.2f MB/s, srtt %" PRIu64 " us, rto %" PRIu64 " us.\n",
+                    sent.packages, sent.syscalls, total / seconds / 1e6, timer.srtt, timer.rto);
+        }
+    }
+    else if (back_id == -4){
+        fprintf(stderr, "ERROR: Message timeout.\n");
+        return 1;
+    }
+    else if (back_id >= 0){  //  Received other code.
+        fprintf(stderr, "ERROR: Received message has wrong package ID.\n");
+        return 1;
+    }
+    else{  // Error while receiving the message.
+        fprintf(stderr, "ERROR: Received message is incorrect.\n");
+        return 1;
+    }
+    return 0;
+}
+
+
+// Reads and validates new protocol. Returns ID of validated protocol.
+int tcp_read_prot(int socket_fd, uint64_t sess_id){
+    static char pack[sizeof(uint8_t) + sizeof(base)];
+    if (tcp_read(socket_fd, pack, sizeof(uint8_t) + sizeof(base)) == 1){
+        return -1;
+    }
+    uint64_t session;
+    uint8_t id;
+    memcpy(&id, pack, sizeof(uint8_t));
+    memcpy(&session, pack + sizeof(uint8_t), sizeof(uint64_t));
+    if (sess_id != session) {  // Checking session ID.
+        fprintf(stderr, "ERROR: Message with wrong session ID\n");
+        return -1;
+    }
+    return id;
+}
+
+
+// Receives CONNACC. Returns 1 if it didn't come, 2 if an optional offer should be tried again without capabilities.
+// If capabilities were offered, agreed ones follow it and are applied to the socket, then offset to resume at.
+int tcp_accepted(int socket_fd, uint64_t sess_id, client_config const *config){
+    int read = tcp_read_prot(socket_fd, sess_id);  // Receiving CONNACC.
+    if ((read == -1 || read == 3) && offer_optional(config)){  // Server closed, rejected or ignored CONN with capabilities.
+        return 2;
+    }
+    if (read == -1){  // Message receive problem.
+        return 1;
+    }
+    else if (read != 2){  // Received ID doesn't match CONACC.
+        fprintf(stderr, "ERROR: Wrong package ID, didn't receive CONNACC.\n");
+        return 1;
+    }
+    if (!config->ext){
+        return 0;
+    }
+    static char caps[CAPS_SIZE];
+    if (tcp_read(socket_fd, caps, sizeof(uint8_t)) == 1){
+        return 1;
+    }
+    size_t size = capabilities_size(caps, sizeof(caps));
+    if (size > sizeof(caps) || tcp_read(socket_fd, caps + sizeof(uint8_t), size - sizeof(uint8_t)) == 1){
+        fprintf(stderr, "ERROR: Received message is incorrect.\n");
+        return 1;
+    }
+    capabilities agreed;
+    read_capabilities(caps, &agreed);
+    if (config->session && agreed.messages == 0){
+        fprintf(stderr, "ERROR: Server doesn't keep sessions.\n");
+        return 1;
+    }
+    if (stripe_ready(&agreed) == 1){
+        return 1;
+    }
+    if (agreed.resume != 0){
+        if (tcp_read(socket_fd, &resume.offset, sizeof(uint64_t)) == 1){
+            return 1;
+        }
+        resume.offset = be64toh(resume.offset);
+    }
+    if (agreed.payload != 0){
+        payload.limit = agreed.payload < payload.limit ? agreed.payload : payload.limit;
+    }
+    if (agreed.timeout != 0){
+        struct timeval timeout = {.tv_sec = agreed.timeout / 1000, .tv_usec = (agreed.timeout % 1000) * 1000};
+        setsockopt(socket_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    }
+    return 0;
+}
+
+
+// Reads DONEs which have already come, without waiting for more.
+// Returns 1 on error or if the server sent something else, e.g. RJT.
+static int tcp_done(int socket_fd, uint64_t sess_id){
+    int waiting = 0;
+    if (ioctl(socket_fd, FIONREAD, &waiting) < 0){
+        fprintf(stderr, "ERROR: Couldn't receive message.\n");
+        return 1;
+    }
+    char pack[sizeof(uint8_t) + sizeof(status)];
+    for (; waiting >= (int) sizeof(pack); waiting -= sizeof(pack)){  // Only whole packages are read.
+        if (tcp_read(socket_fd, pack, sizeof(pack)) == 1){
+            return 1;
+        }
+        uint64_t session;
+        memcpy(&session, pack + sizeof(uint8_t), sizeof(uint64_t));
+        if (session != sess_id){
+            fprintf(stderr, "ERROR: Message with wrong session ID\n");
+            return 1;
+        }
+        else if (pack[0] == 6){
+            fprintf(stderr, "ERROR: Server rejected package.\n");
+            return 1;
+        }
+        else if (pack[0] != 10){
+            fprintf(stderr, "ERROR: Wrong package ID, didn't receive DONE.\n");
+            return 1;
+        }
+        messages_done(pack + sizeof(uint8_t));
+    }
+    return 0;
+}
+
+
+// Sends packages of data using TCP protocol.
+// In early mode the first DATA is written with CONN, so with Fast Open both go in SYN.
+int tcp_conn(char *msg, uint64_t len, int socket_fd, uint64_t sess_id, client_config const *config){
+    static char data[sizeof(uint8_t) + sizeof(conn) + CAPS_SIZE];
+    static char chunk[MAX_MSG];  // Stream is read package by package.
+    uint8_t id = 1;
+    conn pack;
+    uint8_t flags = config->stream ? PROT_STREAM : 0;
+    flags |= config->ext ? PROT_EXT : 0;
+    create_conn(&pack, sess_id, 1 | flags, len);  // CONN.
+    memcpy(data, &id, sizeof(uint8_t));
+    memcpy(data + sizeof(uint8_t), &pack, sizeof(conn));
+    size_t data_len = sizeof(uint8_t) + sizeof(conn);
+    if (config->ext){  // Window is kept by TCP itself.
+        capabilities offer = {.payload = payload.limit, .window = 0, .timeout = config->timeout, .messages = config->session,
+                              .stripes = stripe.count, .stripe = stripe.index, .resume = config->resume, .digest = resume.digest};
+        data_len += write_capabilities(data + data_len, &offer);
+    }
+    if (!config->early && tcp_write(socket_fd, data, data_len) == 1){  // Sending CONN.
+        fprintf(stderr, "ERROR: Couldn't send message.\n");
+        return 1;
+    }
+    int code = config->early ? 0 : tcp_accepted(socket_fd, sess_id, config);
+    if (code != 0){
+        return code;
+    }
+    if (resume.offset > len){  // Resumed transfer is never early.
+        fprintf(stderr, "ERROR: Server resumes past the end of the message.\n");
+        return 1;
+    }
+    msg += resume.offset;
+    len -= resume.offset;
+
+    id = 4;
+    data_msg data_pack;  // DATA.
+    uint64_t pack_id = 0;
+    uint64_t offset = 0;  // Position of the next data in 'msg'.
+    bool more = config->stream || len != 0;  // Some data is left to send.
+    // DATA with CONN is sent before the server agrees to a payload, any server takes that much.
+    uint32_t early_limit = config->ext && payload.limit > PAYLOAD_MIN ? PAYLOAD_MIN : payload.limit;
+    while (more){  // Sending whole package in portions
+        char *part = msg + offset;
+        uint32_t byte_len;
+        bool with_conn = config->early && pack_id == 0;
+        if (config->stream){
+            part = chunk;
+            ssize_t got = read_chunk(chunk, with_conn ? early_limit : payload.limit);
+            if (got < 0){
+                return 1;
+            }
+            byte_len = got;
+            more = byte_len != 0;   // Empty package ends the stream.
+        }
+        else{
+            byte_len = min_msg(len);
+            byte_len = with_conn && byte_len > early_limit ? early_limit : byte_len;
+            len -= byte_len;        // Bytes sent.
+            offset += byte_len;
+            more = len != 0;
+        }
+        create_data(&data_pack, sess_id, pack_id, byte_len);     // Creating new package of data.
+        struct iovec parts[4] = {
+            {.iov_base = data, .iov_len = data_len},
+            {.iov_base = &id, .iov_len = sizeof(uint8_t)},
+            {.iov_base = &data_pack, .iov_len = sizeof(data_msg)},
+            {.iov_base = part, .iov_len = byte_len},    // Message is sent from where it is.
+        };
+        if (tcp_writev(socket_fd, with_conn ? parts : parts + 1, with_conn ? 4 : 3) == 1){  // Sending DATA + message.
+            fprintf(stderr, "ERROR: Couldn't send message.\n");
+            return 1;
+        }
+        code = with_conn ? tcp_accepted(socket_fd, sess_id, config) : 0;
+        if (code != 0){
+            return code;
+        }
+        pack_id++;              // Next pack.
+        // DONEs of a long session are taken now and then, so they don't fill the socket buffers.
+        if (config->session && pack_id % SESSION_POLL == 0 && tcp_done(socket_fd, sess_id) == 1){
+            return 1;
+        }
+    }
+    int read = tcp_read_prot(socket_fd, sess_id);  // Read RCVD.
+    while (read == 10){  // DONE, its count of messages follows.
+        status done = {.session_id = sess_id};
+        if (tcp_read(socket_fd, &done.pack_id, sizeof(uint64_t)) == 1){
             return 1;
         }
+        messages_done((char const *) &done);
+        read = tcp_read_prot(socket_fd, sess_id);
+    }
+    if (read == -1){  // Message receive problem.
+        return 1;
+    }
+    stripe.part = read == 11;  // PART confirms the range of a stripe, RCVD the whole transfer.
+    if (read != 7 && read != 11){  // Received ID doesn't match RCVD.
+        fprintf(stderr, "ERROR: Wrong package ID, didn't receive RCVD.\n");
+        return 1;
+    }
+    return 0;
+}
+
+
+// Maps regular file given as stdin, so DATA is sent straight from the page cache.
+// Returns 1 if stdin can't be mapped, caller reads it instead.
+static int map_input(input *in){
+    struct stat info;
+    if (fstat(STDIN_FILENO, &info) < 0 || !S_ISREG(info.st_mode)){
+        return 1;
+    }
+    off_t start = lseek(STDIN_FILENO, 0, SEEK_CUR);  // Message starts where stdin is positioned.
+    if (start < 0 || start >= info.st_size){
+        return 1;
+    }
+    off_t page = sysconf(_SC_PAGESIZE);
+    off_t base = start - start % page;  // Mapping has to start at page boundary.
+    in->map_len = info.st_size - base;
+    in->map = mmap(NULL, in->map_len, PROT_READ, MAP_PRIVATE, STDIN_FILENO, base);
+    if (in->map == MAP_FAILED){
+        in->map = NULL;
+        return 1;
+    }
+    // Data is read once from start to end, so pages may be read ahead and dropped early.
+    madvise(in->map, in->map_len, MADV_SEQUENTIAL);
+    madvise(in->map, in->map_len < READ_AHEAD ? in->map_len : READ_AHEAD, MADV_WILLNEED);
+    in->msg = in->map + (start - base);
+    in->len = info.st_size - start;
+    return 0;
+}
+
+
+// Reads message from stdin. Regular files are mapped, other inputs are read into memory.
+static int read_input(input *in){
+    memset(in, 0, sizeof(input));
+    if (map_input(in) == 0){
+        return 0;
+    }
+    size_t size = 0;
+    ssize_t code = getdelim(&in->msg, &size, EOF, stdin);
+    if (code == -1) {  // Error while reading message.
+        free(in->msg);
+        fprintf(stderr, "ERROR: Couldn't read message.\n");
+        return 1;
+    }
+    in->len = code;
+    return 0;
+}
+
+
+// Releases message read by read_input.
+static void free_input(input *in){
+    if (in->map != NULL){
+        munmap(in->map, in->map_len);
+    }
+    else{
+        free(in->msg);
+    }
+}
+
+
+// ID of protocol given by its name, 0 if there is none.
+static uint8_t protocol_id(char const *name){
+    char const *names[] = {"tcp", "udp", "udpr", "udpw", "udpn"};
+    for (uint8_t i = 0; i < sizeof(names) / sizeof(names[0]); i++){
+        if (strcmp(name, names[i]) == 0){
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+
+// Sends message over a new socket using protocol with given ID.
+// Server which doesn't negotiate gets the message once more over another socket, without capabilities.
+static int send_message(uint8_t protocol, char *msg, uint64_t len, struct sockaddr_in server_address, uint64_t sess_id,
+                        client_config const *config){
+    int socket_fd = socket(AF_INET, protocol == 1 ? SOCK_STREAM : SOCK_DGRAM, 0);
+    if (socket_fd < 0) {  // There was an error creating a socket.
+        fprintf(stderr,"ERROR: Couldn't create a socket\n");
+        return 1;
+    }
+
+    // Setting timeout on the TCP socket, UDP packages are awaited with deadlines from measured round trip time.
+    struct timeval timeout;
+    timeout.tv_sec = config->timeout / 1000;
+    timeout.tv_usec = (config->timeout % 1000) * 1000;
+    if (protocol == 1 && setsockopt (socket_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof timeout) < 0){
+        fprintf(stderr, "ERROR: Couldn't set timeout on the socket.\n");
         close(socket_fd);
+        return 1;
+    }
+
+    int code;
+    if (protocol != 1){  // Sending the message using UDP protocol.
+        // Confirmations keep coming while the client is busy sending.
+        int buffer_size = SOCKET_BUFFER;
+        setsockopt(socket_fd, SOL_SOCKET, SO_RCVBUF, &buffer_size, sizeof(buffer_size));
+        // Connected socket knows path MTU to the server.
+        if (connect(socket_fd, (struct sockaddr *) &server_address, (socklen_t) sizeof(server_address)) < 0){
+            fprintf(stderr, "ERROR: Couldn't connect to the server.\n");
+            close(socket_fd);
+            return 1;
+        }
+        payload_init(socket_fd, config);
+        // Sending messages to the server.
+        code = udp_conn(msg, len, socket_fd, server_address, sess_id, protocol, config);
     }
     else{
-        free(msg);
+        // Connection is made by the first write, with its data in SYN if the server gave a cookie before.
+        if (config->early){
+            setsockopt(socket_fd, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, &(int){1}, sizeof(int));
+        }
+        // Connecting to the server.
+        if (connect(socket_fd, (struct sockaddr *) &server_address, (socklen_t) sizeof(server_address)) < 0) {
+            fprintf(stderr, "ERROR: Couldn't connect to the server.");
+            close(socket_fd);
+            return 1;
+        }
+        // Sending message to the server.
+        code = tcp_conn(msg, len, socket_fd, sess_id, config);
+    }
+    close(socket_fd);
+    if (code == 2){  // Server doesn't negotiate, defaults hold instead of the offer.
+        client_config plain = *config;
+        plain.ext = false;
+        plain.window = WINDOW;
+        plain.timeout = MAX_WAIT * 1000;
+        return send_message(protocol, msg, len, server_address, sess_id, &plain);
+    }
+    return code;
+}
+
+
+// Sends message as 'stripe.count' byte ranges, each by its own process over its own connection.
+// Session IDs of the ranges start with the first bytes of 'sess_id', which the server joins them by.
+// Data is sent once sessions of all ranges are accepted. Succeeds if one range got RCVD and all others PART.
+static int send_stripes(uint8_t protocol, char *msg, uint64_t len, struct sockaddr_in server_address, uint64_t sess_id,
+                        client_config const *config){
+    int ready[2];
+    int go[2];
+    if (pipe(ready) < 0){
+        fprintf(stderr, "ERROR: Couldn't create pipe.\n");
+        return 1;
+    }
+    if (pipe(go) < 0){
+        fprintf(stderr, "ERROR: Couldn't create pipe.\n");
+        close(ready[0]);
+        close(ready[1]);
+        return 1;
+    }
+    uint32_t started = 0;
+    for (; started < stripe.count; started++){
+        uint64_t first = len * started / stripe.count;
+        uint64_t end = len * (started + 1) / stripe.count;
+        uint64_t stripe_id = gen_sess_id();
+        memcpy(&stripe_id, &sess_id, sizeof(uint32_t));  // Transfer ID.
+        pid_t pid = fork();
+        if (pid < 0){
+            fprintf(stderr, "ERROR: Couldn't start a stripe.\n");
+            break;
+        }
+        if (pid == 0){
+            close(ready[0]);
+            close(go[1]);
+            stripe.index = started;
+            stripe.ready = ready[1];
+            stripe.go = go[0];
+            int code = send_message(protocol, msg + first, end - first, server_address, stripe_id, config);
+            exit(code == 1 ? 1 : stripe.part ? 2 : 0);
+        }
+    }
+    close(ready[1]);
+    close(go[0]);
+    uint32_t accepted = 0;
+    char byte;
+    while (read(ready[0], &byte, sizeof(byte)) == sizeof(byte)){  // Ends when all stripes are accepted or have failed.
+        accepted++;
+    }
+    close(ready[0]);
+    if (accepted == stripe.count){
+        char all[STRIPES_MAX] = {0};
+        if (write(go[1], all, stripe.count) != (ssize_t) stripe.count){
+            accepted = 0;
+        }
+    }
+    close(go[1]);  // Stripes waiting for more fail.
+    uint32_t received = 0;
+    bool failed = accepted != stripe.count;
+    for (uint32_t i = 0; i < started; i++){
+        int status;
+        if (wait(&status) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) == 1){
+            failed = true;
+        }
+        else{
+            received += WEXITSTATUS(status) == 0;
+        }
+    }
+    if (failed){
+        return 1;
+    }
+    if (received != 1){
+        fprintf(stderr, "ERROR: Transfer wasn't confirmed with RCVD.\n");
+        return 1;
+    }
+    return 0;
+}
+
+
+// Reads stdin data. If successful sends data to server using established protocol.
+// Function demands 3 arguments, communication protocol, server id and port id.
+int main(int argc, char *argv[]) {
+    static struct option const options[] = {
+        {"batch", required_argument, NULL, 'b'},
+        {"gap", required_argument, NULL, 'g'},
+        {"stats", no_argument, NULL, 's'},
+        {"stream", no_argument, NULL, 'S'},
+        {"window", required_argument, NULL, 'w'},
+        {"fec", no_argument, NULL, 'f'},
+        {"cc", required_argument, NULL, 'c'},
+        {"rate", required_argument, NULL, 'r'},
+        {"trace", required_argument, NULL, 't'},
+        {"size", required_argument, NULL, 'z'},
+        {"no-gso", no_argument, NULL, 'G'},
+        {"early", no_argument, NULL, 'e'},
+        {"timeout", required_argument, NULL, 'T'},
+        {"negotiate", no_argument, NULL, 'n'},
+        {"session", no_argument, NULL, 'M'},
+        {"streams", required_argument, NULL, 'P'},
+        {"resume", required_argument, NULL, 'R'},
+        {NULL, 0, NULL, 0}
+    };
+    client_config config = {.batch = SEND_BATCH, .gap = 0, .stats = false, .stream = false, .window = WINDOW, .fec = false,
+                            .cc = cc_find("aimd"), .rate = 0, .trace = NULL, .size = 0, .gso = true, .early = false,
+                            .timeout = MAX_WAIT * 1000, .ext = false, .session = false, .streams = 1,
+                            .resume = 0};
+    bool negotiate = false;
+    bool error = false;
+    int option;
+    while ((option = getopt_long(argc, argv, "", options, NULL)) != -1){
+        if (option == 'b'){
+            config.batch = read_number(optarg, 1, UIO_MAXIOV, &error);
+        }
+        else if (option == 'g'){
+            config.gap = read_number(optarg, 0, UINT32_MAX, &error);
+        }
+        else if (option == 's'){
+            config.stats = true;
+        }
+        else if (option == 'S'){
+            config.stream = true;
+        }
+        else if (option == 'w'){
+            config.window = read_number(optarg, 1, WINDOW, &error);
+        }
+        else if (option == 'f'){
+            config.fec = true;
+        }
+        else if (option == 'c'){
+            config.cc = cc_find(optarg);
+            error = error || (config.cc == NULL && strcmp(optarg, "none") != 0);
+        }
+        else if (option == 'r'){
+            config.rate = read_number(optarg, 1, 1000000, &error) * 1000000;  // Given in MB/s.
+        }
+        else if (option == 'z'){
+            config.size = read_number(optarg, 1, MAX_MSG, &error);
+        }
+        else if (option == 'G'){
+            config.gso = false;
+        }
+        else if (option == 'e'){
+            config.early = true;
+        }
+        else if (option == 'T'){
+            config.timeout = read_number(optarg, TIMEOUT_MIN, TIMEOUT_MAX, &error);
+        }
+        else if (option == 'n'){
+            negotiate = true;
+        }
+        else if (option == 'M'){
+            config.session = true;
+        }
+        else if (option == 'P'){
+            config.streams = read_number(optarg, 1, STRIPES_MAX, &error);
+        }
+        else if (option == 'R'){
+            config.resume = read_number(optarg, 1, UINT32_MAX, &error);
+        }
+        else if (option == 't'){
+            if (config.trace != NULL){
+                fclose(config.trace);
+            }
+            config.trace = fopen(optarg, "w");
+            if (config.trace == NULL){
+                fprintf(stderr, "ERROR: Couldn't open trace file.\n");
+                return 1;
+            }
+        }
+        else{
+            error = true;
+        }
+    }
+    if (error || argc - optind != 3) {  // Checks for 3 arguments.
+        fprintf(stderr, "ERROR: Expected arguments: %s <communication protocol> <server id> <port> [--batch N] [--gap US] [--stats] [--stream] [--window N] [--fec]\n"
+                        "    [--cc aimd|delay|none] [--rate MB/s] [--trace FILE] [--size N] [--no-gso] [--early]\n"
+                        "    [--timeout MS] [--negotiate] [--session] [--streams N] [--resume ID]\n", argv[0]);
+        return 1;
+    }
+    // Capabilities are offered only when they differ from the defaults, so older servers still accept the client.
+    config.ext = negotiate || config.size != 0 || config.window != WINDOW || config.timeout != MAX_WAIT * 1000 || config.session ||
+                 config.streams > 1 || config.resume != 0;
+    if (config.session){  // Messages are read while they are sent, each is confirmed when written.
+        config.stream = true;
+        messages.framed = true;
+        framer_init(&messages.read);
+    }
+    if (config.size != 0){
+        payload.limit = config.size;
+    }
+    char const *protocol = argv[optind];  // Communication protocol.
+    uint8_t id = protocol_id(protocol);
+    if (id == 0){
         fprintf(stderr, "ERROR: Wrong protocol.\n");
         return 1;
     }
-    free(msg);
+    // Ranges are cut from the whole message, they start only after all stripes are accepted.
+    if (config.streams > 1 && (config.stream || config.early)){
+        fprintf(stderr, "ERROR: Striped transfer is available without --stream, --session and --early only.\n");
+        return 1;
+    }
+    // Server tells where to resume in CONNACC, before any data.
+    if (config.resume != 0 && (config.stream || config.early || config.streams > 1)){
+        fprintf(stderr, "ERROR: Resumed transfer is available without --stream, --session, --early and --streams only.\n");
+        return 1;
+    }
+    if (config.fec && strcmp(protocol, "udp") != 0){  // Other protocols recover lost packages by retransmissions.
+        fprintf(stderr, "ERROR: Forward error correction is available for udp only.\n");
+        return 1;
+    }
+    // Windowed and NACK modes confirm packages from the first one, FEC parity covers whole blocks.
+    if (config.early && (config.fec || (strcmp(protocol, "tcp") != 0 && strcmp(protocol, "udp") != 0 && strcmp(protocol, "udpr") != 0))){
+        fprintf(stderr, "ERROR: Data with CONN is available for tcp, udp and udpr without FEC only.\n");
+        return 1;
+    }
+    char const *host = argv[optind + 1];  // Server id.
+    uint16_t port = read_port(argv[optind + 2], &error);
+    if (error){  // There was an error getting port.
+        return 1;
+    }
+
+    input in = {0};  // Whole message, stream is read while it is sent.
+    if (!config.stream && read_input(&in) == 1){  // Tries to read message.
+        return 1;
+    }
+    if (!config.stream && in.len == 0){  // Empty message.
+        free_input(&in);
+        fprintf(stderr, "ERROR: Empty message won't be send.\n");
+        return 1;
+    }
+
+    if (config.resume != 0){
+        resume.digest = message_digest(in.msg, in.len);
+    }
+    stripe.count = config.streams < in.len ? config.streams : in.len;  // Every range has some data.
+    stripe.count = stripe.count > 1 ? stripe.count : 0;
+    uint64_t sess_id = gen_sess_id();  // Generating session id.
+    int sock = id == 1 ? SOCK_STREAM : SOCK_DGRAM;  // Protocol settings.
+    int prot = id == 1 ? IPPROTO_TCP : IPPROTO_UDP;
+    error = false;
+    struct sockaddr_in server_address = get_server_address(host, port, &error, AF_INET, sock, prot);
+    if (error){  // There was an error getting server address.
+        free_input(&in);
+        return 1;
+    }
+    int code = stripe.count > 0 ? send_stripes(id, in.msg, in.len, server_address, sess_id, &config)
+                                : send_message(id, in.msg, in.len, server_address, sess_id, &config);
+    if (code == 1){
+        free_input(&in);
+        return 1;
+    }
+    if (config.stats && config.session){
+        fprintf(stderr, "STATS: %" PRIu64 " messages, %" PRIu64 " confirmed with DONE before RCVD.\n", messages.read.messages,
+                messages.confirmed);
+    }
+    if (config.stats && config.resume != 0){
+        fprintf(stderr, "STATS: %" PRIu64 " bytes written before, %" PRIu64 " sent.\n", resume.offset, in.len - resume.offset);
+    }
+    free_input(&in);
     return 0;
 }
@@ -4,32 +4,108 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/uio.h>
+#include <pthread.h>
+#include <sched.h>
+#include <linux/filter.h>
+#include <sys/resource.h>
+#include <fcntl.h>
+#include <getopt.h>
 #include <arpa/inet.h>
+#include <netinet/udp.h>
+#include <netinet/tcp.h>
 #include <stdbool.h>
 #include "common.h"
 #include "protconst.h"
+#include "session.h"
+#include "pool.h"
+#include "rtt.h"
+#include "fec.h"
+#include "ring.h"
+#include "output.h"
+#include "frame.h"
+#include "stripe.h"
+#include "checkpoint.h"
 
-// Ends connection with current client.
-// Sets 'session ID', 'Bites to read' and 'last read package' to default values.
-void to_default(uint64_t *last, bool *udpr, uint64_t *trials, bool *connected){
-    *last = 0;
-    *udpr = false;
-    *connected = false;
-    *trials = 0;
+// Server settings given as options.
+typedef struct server_config{
+    size_t max_sessions;     // Max number of clients served at once.
+    size_t window_buffers;   // Max number of packages held out of order by all sessions.
+    size_t workers;          // Number of UDP worker threads.
+    size_t batch;            // Max number of datagrams received with one syscall.
+    bool stats;              // Report statistics on stderr.
+    bool splice;             // Move TCP data to stdout with splice.
+    bool gro;                // Kernel may merge datagrams of a client, they are split before handling.
+    uint32_t reorder;        // Packages plain UDP clients may send ahead of a missing one.
+    uint32_t payload;        // Max data size of DATA clients may send.
+    uint32_t timeout;        // Time (ms) without packages after which a client is disconnected, the most a client may ask for.
+    int checkpoints;         // Directory of records of resumable transfers, -1 if transfers aren't resumed.
+} server_config;
+
+
+// Guards stdout shared by UDP workers.
+static pthread_mutex_t output_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// UDP workers serve only once all of them are started, their sockets are closed if one couldn't be.
+static pthread_mutex_t start_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t start_cond = PTHREAD_COND_INITIALIZER;
+static int start_state = 0;  // 0 while workers are started, 1 once all are and -1 if some couldn't be.
+
+
+// Ends connection with the client, its session is removed from the table.
+// Messages it still waits DONE for are confirmed by RCVD or not at all, its striped transfer fails unless the range is whole.
+// Resumable transfer with data still in the output records it only once it is written.
+void to_default(session_table *table, session *s){
+    if (s->record.fd >= 0){
+        // Session which isn't queued had its progress recorded by the last batch, or its data wasn't written.
+        if (s->done_queued && output_flush(table->out) == 0 && !table->out->failed){
+            checkpoint_save(&s->record, s->record.length - s->unpack);
+        }
+        checkpoint_close(&s->record);
+    }
+    if (s->transfer != NULL){
+        transfer_leave(&table->transfers, s->transfer, s->stripe);
+    }
+    if (s->done_queued){
+        for (size_t i = 0; i < table->done_count; i++){
+            if (table->done[i] == s->sess_id){
+                table->done[i] = table->done[--table->done_count];
+                break;
+            }
+        }
+    }
+    session_remove(table, s);
+}
+
+
+// Sets time of the next retransmission to UDPR client, or of disconnecting UDP client.
+void udp_deadline(session_table *table, session *s, uint64_t now){
+    uint64_t wait = s->wait;
+    if (s->nack){  // NACKs are repeated while client is silent, less and less often.
+        wait = (uint64_t) NACK_INTERVAL << (s->trials < 7 ? s->trials : 7);
+    }
+    else if (s->udpr){
+        wait = s->timer.rto;
+    }
+    else if (s->highest > s->last){  // Packages of plain UDP client held after a gap wait for it only a while.
+        uint64_t end = s->gap_since + REORDER_TIMEOUT;
+        wait = end > now ? end - now : 0;
+    }
+    session_deadline(table, s, now + wait);
 }
 
 
 // Sends 'to_send' package to client.
 int send_pack(uint8_t id, int socket_fd, void *to_send, size_t size, struct sockaddr_in client_address, socklen_t address_length){
     int code = 0;
-    void *buffer = malloc(size + sizeof(uint8_t));
-    if (malloc_error(buffer) == 1){
-        return 1;
-    }
-    memcpy(buffer, &id, sizeof(uint8_t));
-    memcpy(buffer + sizeof(uint8_t), to_send, size);
-    ssize_t sent_length = sendto(socket_fd, buffer, size + sizeof(uint8_t), 0,
-                                 (struct sockaddr *) &client_address, address_length);
+    struct iovec parts[2] = {
+        {.iov_base = &id, .iov_len = sizeof(uint8_t)},
+        {.iov_base = to_send, .iov_len = size},
+    };
+    struct msghdr message = {.msg_name = &client_address, .msg_namelen = address_length, .msg_iov = parts, .msg_iovlen = 2};
+    ssize_t sent_length = sendmsg(socket_fd, &message, 0);
 
     if (sent_length < 0) {  // Couldn't send.
         fprintf(stderr, "ERROR: Couldn't send Package.\n");
@@ -39,425 +115,1672 @@ int send_pack(uint8_t id, int socket_fd, void *to_send, size_t size, struct sock
         fprintf(stderr, "ERROR: Package was sent incompletely.\n");
         code = 1;
     }
-    free(buffer);
     return code;
 }
 
 
+// Sends CONNACC, followed by the agreed capabilities if the client offered some
+// and by the offset to resume at if the transfer is resumable.
+int send_conacc(session const *s, int socket_fd, struct sockaddr_in client_address, socklen_t address_length){
+    char to_send[sizeof(base) + CAPS_SIZE + sizeof(uint64_t)];
+    create_base((base *) to_send, s->sess_id);
+    size_t size = sizeof(base);
+    if (s->ext){
+        size += write_capabilities(to_send + sizeof(base), &s->agreed);
+    }
+    if (s->agreed.resume != 0){
+        uint64_t offset = htobe64(s->resumed);
+        memcpy(to_send + size, &offset, sizeof(uint64_t));
+        size += sizeof(uint64_t);
+    }
+    return send_pack(2, socket_fd, to_send, size, client_address, address_length);
+}
+
+
+// Agrees to capabilities 'offer' of a client within 'limits'.
+// 'window' is the most packages held by the client's mode, 0 if it doesn't keep a window.
+capabilities agree(capabilities const *offer, capabilities const *limits, uint32_t window){
+    capabilities agreed = {0};
+    if (offer->payload != 0){
+        agreed.payload = offer->payload < limits->payload ? offer->payload : limits->payload;
+    }
+    if (offer->window != 0 && window != 0){
+        agreed.window = offer->window < window ? offer->window : window;
+    }
+    if (offer->timeout != 0){
+        agreed.timeout = offer->timeout < TIMEOUT_MIN ? TIMEOUT_MIN : offer->timeout > limits->timeout ? limits->timeout : offer->timeout;
+    }
+    if (offer->messages != 0){
+        agreed.messages = limits->messages;
+    }
+    if (offer->stripes != 0 && offer->stripes <= limits->stripes){
+        agreed.stripes = offer->stripes;
+        agreed.stripe = offer->stripe;
+    }
+    if (offer->resume != 0 && limits->resume != 0){
+        agreed.resume = offer->resume;
+        agreed.digest = offer->digest;
+    }
+    return agreed;
+}
+
+
+// Sends windowed ACC describing all packages received from the client.
+int send_window_ack(session const *s, int socket_fd, struct sockaddr_in client_address, socklen_t address_length){
+    uint64_t mask = 0;
+    for (uint64_t i = 0; i + 1 < s->span; i++){
+        if (s->held[(s->last + 1 + i) % s->span] != POOL_NONE){
+            mask |= 1ULL << i;
+        }
+    }
+    window_ack to_send;
+    create_window_ack(&to_send, s->sess_id, s->last, mask);
+    return send_pack(5, socket_fd, &to_send, sizeof(window_ack), client_address, address_length);
+}
+
+
+// Sends NACK listing packages missing between the last and the highest received one.
+// It also confirms all packages before the last, so the client may send further.
+int send_nack(session *s, int socket_fd, struct sockaddr_in client_address, socklen_t address_length){
+    char to_send[sizeof(nack) + NACK_RANGES * sizeof(nack_range)];
+    uint16_t count = 0;
+    uint64_t pack_id = s->last;
+    while (pack_id < s->highest && count < NACK_RANGES){
+        if (s->held[pack_id % s->span] != POOL_NONE){
+            pack_id++;
+            continue;
+        }
+        uint64_t first = pack_id;
+        while (pack_id < s->highest && s->held[pack_id % s->span] == POOL_NONE){
+            pack_id++;
+        }
+        create_nack_range((nack_range *) (to_send + sizeof(nack) + count * sizeof(nack_range)), first, pack_id - first);
+        count++;
+    }
+    create_nack((nack *) to_send, s->sess_id, s->last, s->highest, count);
+    s->unconfirmed = 0;
+    return send_pack(8, socket_fd, to_send, sizeof(nack) + count * sizeof(nack_range), client_address, address_length);
+}
+
+
+// Notes package received from NACK client. NACK is sent as soon as a new gap appears or a package
+// fills one, so retransmissions are confirmed at once, and after every 'NACK_EVERY' packages.
+void nack_confirm(session *s, uint64_t pack_id, int socket_fd, struct sockaddr_in client_address, socklen_t address_length){
+    bool gap = pack_id != s->highest;  // Packages between were lost or reordered, or this one was.
+    if (pack_id >= s->highest){
+        s->highest = pack_id + 1;
+    }
+    s->unconfirmed++;
+    if ((gap || s->unconfirmed >= NACK_EVERY) && send_nack(s, socket_fd, client_address, address_length) == 1){
+        fprintf(stderr, "ERROR: Couldn't send NACK\n");
+    }
+}
+
+
+// Keeps copy of a package received ahead of the next expected one.
+// If all buffers are taken, the package is dropped and the client sends it again.
+// Returns 1 if the package wasn't kept, because it is already held or there is no free buffer.
+int hold_package(session_table *table, session *s, void *msg, uint64_t pack_id, uint32_t byte_len){
+    size_t i = pack_id % s->span;
+    if (s->held[i] != POOL_NONE){  // Retransmission of a held package.
+        return 1;
+    }
+    uint32_t buffer = pool_get(&table->window);
+    if (buffer == POOL_NONE){
+        return 1;
+    }
+    memcpy(pool_buffer(&table->window, buffer), msg, byte_len);
+    s->held[i] = buffer;
+    s->held_len[i] = byte_len;
+    return 0;
+}
+
+
+// Holds package of plain UDP client received ahead of a gap, which then has 'REORDER_TIMEOUT' to fill.
+// Client doesn't send packages again, so it is rejected if no buffer is free. Duplicates are ignored.
+int reorder_hold(session_table *table, session *s, void *msg, uint64_t pack_id, uint32_t byte_len,
+                 int socket_fd, struct sockaddr_in client_address, socklen_t address_length){
+    if (pack_id < s->last || s->held[pack_id % s->span] != POOL_NONE){
+        return 0;
+    }
+    if (hold_package(table, s, msg, pack_id, byte_len) == 1){
+        fprintf(stderr, "ERROR: No room for packages received out of order.\n");
+        status to_send;
+        create_status(&to_send, s->sess_id, s->last);  // RJT
+        to_default(table, s);
+        if (send_pack(6, socket_fd, &to_send, sizeof(status), client_address, address_length) == 1){ // Sends RJT.
+            fprintf(stderr, "ERROR: Couldn't sent RJT.\n");
+        }
+        return 1;
+    }
+    uint64_t now = mono_us();
+    if (s->highest <= s->last){  // New gap.
+        s->gap_since = now;
+    }
+    if (pack_id >= s->highest){
+        s->highest = pack_id + 1;
+    }
+    udp_deadline(table, s, now);
+    return 0;
+}
+
+
+// Adds package received from FEC client to the parity of its block.
+void fec_absorb(session_table *table, session *s, uint64_t pack_id, void const *msg, uint32_t byte_len){
+    uint64_t first = pack_id - pack_id % FEC_BLOCK;
+    if (s->block.first != first){  // Previous block is complete.
+        fec_reset(&s->block, first);
+    }
+    fec_add(&s->block, pool_buffer(&table->window, s->parity), msg, byte_len);
+}
+
+
+// Passes data of a package to the output, stripe passes it through its transfer. Framed session with newly
+// completed messages is queued for DONE, resumable session is queued for record of its progress.
+int session_output(session_table *table, session *s, output *out, void *data, uint32_t byte_len){
+    if (s->transfer != NULL){
+        return transfer_push(s->transfer, s->stripe, out, data, byte_len);
+    }
+    if (s->record.fd >= 0 && !s->done_queued){
+        s->done_queued = true;
+        table->done[table->done_count++] = s->sess_id;
+    }
+    if (output_push(out, data, byte_len) == 1){
+        return 1;
+    }
+    if (!s->framed){
+        return 0;
+    }
+    uint64_t before = s->frames.messages;
+    framer_scan(&s->frames, data, byte_len);
+    if (s->frames.messages != before && !s->done_queued){
+        s->done_queued = true;
+        table->done[table->done_count++] = s->sess_id;
+    }
+    return 0;
+}
+
+
+// Sends DONE to framed sessions queued since the last flush and records progress of resumable ones,
+// if the output was written. Otherwise resumable sessions end, their record stays before the lost data.
+void udp_done(session_table *table, int socket_fd, bool written){
+    for (size_t i = 0; i < table->done_count; i++){
+        session *s = session_find(table, table->done[i]);  // Ended sessions have left the queue.
+        s->done_queued = false;
+        if (!written && s->record.fd >= 0){
+            fprintf(stderr, "ERROR: Couldn't write message. Disconnecting client.\n");
+            to_default(table, s);
+            continue;
+        }
+        if (s->record.fd >= 0){
+            checkpoint_save(&s->record, s->record.length - s->unpack);
+        }
+        status to_send;
+        create_status(&to_send, s->sess_id, s->frames.messages);  // DONE
+        if (written && s->framed && send_pack(10, socket_fd, &to_send, sizeof(status), s->client, sizeof(s->client)) == 1){
+            fprintf(stderr, "ERROR: Couldn't send DONE.\n");
+        }
+    }
+    table->done_count = 0;
+}
+
+
+// Passes held packages which follow already received ones to the output.
+// Their buffers return to the pool only after the output is flushed.
+// Package of a stripe without room for it stays held, it was already confirmed, so it is released later.
+int release_held(session_table *table, session *s, output *out){
+    uint32_t released[NACK_WINDOW];
+    size_t count = 0;
+    int code = 0;
+    while (s->unpack > 0 && s->held[s->last % s->span] != POOL_NONE){
+        size_t i = s->last % s->span;
+        uint32_t byte_len = s->held_len[i];
+        if (s->udpr && s->transfer != NULL && !transfer_room(s->transfer, s->stripe, byte_len)){
+            break;
+        }
+        released[count++] = s->held[i];
+        s->held[i] = POOL_NONE;
+        if (byte_len > s->unpack){
+            fprintf(stderr, "ERROR: Client sent package with incorrect size.\n");
+            code = 1;
+            break;
+        }
+        if (session_output(table, s, out, pool_buffer(&table->window, released[count - 1]), byte_len) == 1){
+            code = 1;
+            break;
+        }
+        s->unpack -= byte_len;
+        s->last++;
+        if (s->stream && byte_len == 0){  // End of the stream.
+            s->unpack = 0;
+        }
+    }
+    if (count > 0 && output_flush(out) == 1){
+        code = 1;
+    }
+    for (size_t j = 0; j < count; j++){
+        pool_put(&table->window, released[j]);
+    }
+    return code;
+}
+
+
+// Sends RCVD if the whole message is received and written, the session ends.
+// Stripe gets RCVD only if its range completes the transfer, otherwise PART.
+// Returns 1 if the message couldn't be written.
+int udp_received(session_table *table, session *s, output *out, int socket_fd, struct sockaddr_in client_address, socklen_t address_length){
+    if (s->unpack > 0){
+        return 0;
+    }
+    if (output_flush(out) == 1 || out->failed){  // Everything has to be written before RCVD.
+        to_default(table, s);
+        fprintf(stderr, "ERROR: Couldn't write message. Disconnecting client.\n");
+        return 1;
+    }
+    if (s->framed && !framer_whole(&s->frames)){
+        fprintf(stderr, "ERROR: Session ended inside a message.\n");
+        status rjt;
+        create_status(&rjt, s->sess_id, s->last - 1);  // RJT of the empty DATA.
+        to_default(table, s);
+        if (send_pack(6, socket_fd, &rjt, sizeof(status), client_address, address_length) == 1){
+            fprintf(stderr, "ERROR: Couldn't sent RJT.\n");
+        }
+        return 1;
+    }
+    uint8_t id = 7;
+    if (s->transfer != NULL){
+        if (transfer_whole(s->transfer, s->stripe, out) == 1){  // Ranges held behind this one are written.
+            to_default(table, s);
+            fprintf(stderr, "ERROR: Couldn't write message. Disconnecting client.\n");
+            return 1;
+        }
+        id = transfer_done(s->transfer) ? 7 : 11;
+    }
+    if (s->record.fd >= 0){  // Later transfers of the message are only confirmed.
+        checkpoint_finish(&s->record);
+    }
+    status done;
+    create_status(&done, s->sess_id, s->frames.messages);  // DONE of all messages comes before RCVD.
+    if (s->framed && send_pack(10, socket_fd, &done, sizeof(status), client_address, address_length) == 1){
+        fprintf(stderr, "ERROR: Couldn't send DONE.\n");
+    }
+    base rcvd;
+    create_base(&rcvd, s->sess_id);  // RCVD or PART
+    to_default(table, s);  // Ends connection with client.
+    if (send_pack(id, socket_fd, &rcvd, sizeof(base), client_address, address_length) == 1){  // Sends RCVD.
+        fprintf(stderr, "ERROR: Couldn't send RECV\n");
+    }
+    return 0;
+}
+
+
+// Confirms again packages before the next expected one, which a stripe without room doesn't take yet.
+// Client sends that package again later, and knows the server is alive meanwhile.
+void confirm_again(session *s, int socket_fd, struct sockaddr_in client_address, socklen_t address_length){
+    status to_send;
+    int code = 0;
+    if (s->nack){
+        code = send_nack(s, socket_fd, client_address, address_length);
+    }
+    else if (s->windowed){
+        code = send_window_ack(s, socket_fd, client_address, address_length);
+    }
+    else if (s->last > 0){  // Stop-and-wait client gets ACC of the previous package.
+        create_status(&to_send, s->sess_id, s->last - 1);
+        code = send_pack(5, socket_fd, &to_send, sizeof(status), client_address, address_length);
+    }
+    if (code == 1){
+        fprintf(stderr, "ERROR: Couldn't send ACC\n");
+    }
+}
+
+
 // Handles 'DATA' packages.
-// 'sess_id' - ID current connection with client, 'unpack' - number of bites left to recieve from all packages,
-// 'last' - ID of last received package, 'prot' - received package with information about 'msg', 'msg' - received bites.
-// ACC send and check other things with retransmissions in server.
-int DATA_handler(void* msg, uint64_t *unpack, uint64_t *last, bool *udpr, bool *connected, uint64_t *trials, data_msg prot,
+// 's' - session of the client which sent the package, 'prot' - header of the package as received,
+// 'msg' - received bites, both point into the receive buffer. ACC send and check other things with retransmissions in server.
+int DATA_handler(void* msg, session_table *table, session *s, data_msg const *prot, output *out,
                   int socket_fd, struct sockaddr_in client_address, socklen_t address_length){
     status to_send;
+    uint64_t sess_id = prot->session_id;
+    uint64_t pack_id = be64toh(prot->pack_id);
+    uint32_t byte_len = be32toh(prot->byte_len);
+    // Windowed and NACK clients may send packages ahead of the next expected one and repeat any earlier.
+    // Plain UDP client's packages may come reordered, up to the span after the next expected one.
+    // FEC client's packages following a lost one wait for the parity of their block.
+    bool reorder = !s->udpr && !s->fec && s->span > 0;
+    // Stripe which had no room for its next held package takes it once it has, the client doesn't send it again.
+    bool blocked = s->transfer != NULL && s->span > 0 && s->held[s->last % s->span] != POOL_NONE;
+    if (blocked && release_held(table, s, out) == 1){
+        to_default(table, s);
+        fprintf(stderr, "ERROR: Couldn't write message. Disconnecting client.\n");
+        return 1;
+    }
+    if (blocked && s->unpack == 0){
+        return udp_received(table, s, out, socket_fd, client_address, address_length);
+    }
+    blocked = blocked && s->held[s->last % s->span] != POOL_NONE;
+    bool ahead = s->fec ? pack_id > s->last && pack_id / FEC_BLOCK == s->last / FEC_BLOCK
+                        : s->span > 0 && s->last != pack_id && (pack_id < s->last || pack_id - s->last < s->span);
+    if (ahead && reorder){
+        return reorder_hold(table, s, msg, pack_id, byte_len, socket_fd, client_address, address_length);
+    }
+    if (ahead){
+        if (pack_id > s->last && hold_package(table, s, msg, pack_id, byte_len) == 0 && s->fec){
+            fec_absorb(table, s, pack_id, msg, byte_len);
+        }
+        s->trials = 0;
+        if (s->fec){  // Plain UDP client isn't confirmed.
+            return 0;
+        }
+        else if (s->nack){
+            nack_confirm(s, pack_id, socket_fd, client_address, address_length);
+        }
+        else if (send_window_ack(s, socket_fd, client_address, address_length) == 1){  // Sends ACC.
+            fprintf(stderr, "ERROR: Couldn't send ACC\n");
+        }
+        return 0;
+    }
+    if (blocked && pack_id > s->last){  // Client's window moved past the held packages, it sends this one again.
+        confirm_again(s, socket_fd, client_address, address_length);
+        return 0;
+    }
     // Checks if package's ID is correct.
-    if ((*last < prot.pack_id && *udpr) || (*last != prot.pack_id && !(*udpr))){
+    if ((s->last < pack_id && s->udpr) || (s->last != pack_id && !s->udpr)){
         fprintf(stderr, "ERROR: Client sent a package with wrong ID.\n");
-        create_status(&to_send, prot.session_id, prot.pack_id);  // RJT
-        to_default(last, udpr, trials, connected);  // Ends connection with client, so parameters are being set to default values.
+        create_status(&to_send, sess_id, pack_id);  // RJT
+        to_default(table, s);  // Ends connection with client.
         if (send_pack(6, socket_fd, &to_send, sizeof(status), client_address, address_length) == 1){ // Sends RJT.
             fprintf(stderr, "ERROR: Couldn't sent RJT.\n");
         }
     }
     // If package size is bigger than size left to read, and it is not a retransmission.
-    else if (prot.byte_len > *unpack && prot.pack_id == *last){
+    else if (byte_len > s->unpack && pack_id == s->last){
         fprintf(stderr, "ERROR: Client sent package with incorrect size.\n");
-        to_default(last, udpr, trials, connected);
+        to_default(table, s);
     }
-    else if (!(*last > prot.pack_id && *udpr)){  // Protocol is correct.
-        if (write(STDOUT_FILENO, msg, prot.byte_len) < 0){   // Writing message to stdout.
-            fflush(stdout);
-            to_default(last, udpr, trials, connected);
+    else if (!(s->last > pack_id && s->udpr)){  // Protocol is correct.
+        // Stripe behind the head waits for room to hold its data, client sends the package again.
+        if (s->udpr && s->transfer != NULL && !transfer_room(s->transfer, s->stripe, byte_len)){
+            confirm_again(s, socket_fd, client_address, address_length);
+            return 0;
+        }
+        if (session_output(table, s, out, msg, byte_len) == 1){   // Message waits for stdout with other packages.
+            to_default(table, s);
             fprintf(stderr, "ERROR: Couldn't write message. Disconnecting client.\n");
             return 1;
         }
-        fflush(stdout);
-        *unpack -= prot.byte_len;  // Reduces the number of bites to read in the future.
-        *last = *last + 1;  // Next package ID update.
+        if (s->fec){
+            fec_absorb(table, s, pack_id, msg, byte_len);
+        }
+        s->unpack -= byte_len;  // Reduces the number of bites to read in the future.
+        s->last = s->last + 1;  // Next package ID update.
+        if (s->stream && byte_len == 0){  // End of the stream.
+            s->unpack = 0;
+        }
+        if (s->span > 0 && release_held(table, s, out) == 1){  // Packages received earlier follow.
+            to_default(table, s);
+            fprintf(stderr, "ERROR: Couldn't write message. Disconnecting client.\n");
+            return 1;
+        }
+        if (reorder){  // Gap was filled, the next one waits from now.
+            if (s->last > pack_id + 1 && s->highest > s->last){
+                s->gap_since = mono_us();
+            }
+            udp_deadline(table, s, mono_us());
+        }
 
-        if (*udpr){  // Sending ACC.
-            *trials = 0;
-            create_status(&to_send,  prot.session_id, prot.pack_id); // ACC
-            if (send_pack(5, socket_fd, &to_send, sizeof(status), client_address, address_length) == 1){  // Sends ACC.
+        if (s->nack){  // Client is told about gaps only.
+            s->trials = 0;
+            nack_confirm(s, pack_id, socket_fd, client_address, address_length);
+        }
+        else if (s->windowed){  // Sending ACC of the whole window.
+            s->trials = 0;
+            if (send_window_ack(s, socket_fd, client_address, address_length) == 1){
                 fprintf(stderr, "ERROR: Couldn't send ACC\n");
             }
         }
-        if (*unpack == 0){  // If whole message is read.
-            base rcvd;
-            create_base(&rcvd, prot.session_id);  // RCVD
-            to_default(last, udpr, trials, connected);  // Ends connection with client, so parameters are being set to default values.
-            if (send_pack(7, socket_fd, &rcvd, sizeof(base), client_address, address_length) == 1){  // Sends RCVD.
-                fprintf(stderr, "ERROR: Couldn't send RECV\n");
+        else if (s->udpr){  // Sending ACC.
+            uint64_t now = mono_us();
+            if (s->trials == 0){  // Package confirms the only transmission of the last ACC, so it measures round trip time.
+                rtt_sample(&s->timer, now - s->sent_at, now);
             }
+            s->trials = 0;
+            create_status(&to_send, sess_id, pack_id); // ACC
+            if (send_pack(5, socket_fd, &to_send, sizeof(status), client_address, address_length) == 1){  // Sends ACC.
+                fprintf(stderr, "ERROR: Couldn't send ACC\n");
+            }
+            s->sent_at = now;
+            udp_deadline(table, s, now);
         }
+        return udp_received(table, s, out, socket_fd, client_address, address_length);  // If whole message is read.
     }
     return 0;
 }
 
 
+// Handles 'PARITY' packages of FEC client.
+// Single missing package of the block is rebuilt from the parity and the other packages of the block,
+// held packages which follow it are written too. Client is rejected if more packages of the block are missing.
+int PARITY_handler(char const *parity, session_table *table, session *s, parity_msg const *prot, output *out,
+                   int socket_fd, struct sockaddr_in client_address, socklen_t address_length){
+    uint64_t first = be64toh(prot->pack_id);
+    uint32_t count = be32toh(prot->count);
+    uint32_t byte_len = be32toh(prot->byte_len);
+    if (first + count <= s->last){  // Nothing was lost.
+        return 0;
+    }
+    if (s->block.first != first){  // No package of the block was received.
+        fec_reset(&s->block, first);
+    }
+    uint32_t rebuilt_len = be32toh(prot->len_xor) ^ s->block.len_xor;
+    uint32_t buffer = POOL_NONE;
+    if (first % FEC_BLOCK == 0 && first <= s->last && count == s->block.count + 1 &&
+        s->block.byte_len <= byte_len && rebuilt_len <= byte_len){  // Only the next expected package is missing.
+        buffer = pool_get(&table->window);
+    }
+    if (buffer == POOL_NONE){  // Too many packages were lost.
+        fprintf(stderr, "ERROR: Client lost packages which can't be rebuilt.\n");
+        status to_send;
+        create_status(&to_send, s->sess_id, s->last);  // RJT
+        to_default(table, s);
+        if (send_pack(6, socket_fd, &to_send, sizeof(status), client_address, address_length) == 1){ // Sends RJT.
+            fprintf(stderr, "ERROR: Couldn't sent RJT.\n");
+        }
+        return 1;
+    }
+    char *rebuilt = pool_buffer(&table->window, buffer);
+    memcpy(rebuilt, parity, byte_len);
+    fec_xor(rebuilt, pool_buffer(&table->window, s->parity), s->block.byte_len);
+    s->held[s->last % s->span] = buffer;  // Rebuilt package is written with those held after it.
+    s->held_len[s->last % s->span] = rebuilt_len;
+    if (release_held(table, s, out) == 1){
+        to_default(table, s);
+        fprintf(stderr, "ERROR: Couldn't write message. Disconnecting client.\n");
+        return 1;
+    }
+    return udp_received(table, s, out, socket_fd, client_address, address_length);
+}
+
+
+// Checks the first DATA package which came in 'early_len' bytes after CONN.
+bool early_correct(conn const *recv, char const *early, size_t early_len, uint32_t max_payload){
+    if (early_len < sizeof(uint8_t) + sizeof(data_msg) || early[0] != 4){
+        return false;
+    }
+    data_msg const *data = (data_msg const *) (early + sizeof(uint8_t));
+    uint32_t byte_len = be32toh(data->byte_len);
+    return data->session_id == recv->session_id && be64toh(data->pack_id) == 0 && byte_len <= max_payload &&
+           early_len >= sizeof(uint8_t) + sizeof(data_msg) + byte_len;
+}
+
+
 // Handles 'CONN' packages.
-// 'sess_id' - ID current connection with client, 'unpack' - number of bites left to recieve from all packages,
-// 'last' - ID of last received package, 'prot' - received package with information about request to connect.
-int CONN_handler(conn recv, uint64_t *sess_id, uint64_t *unpack, bool *udpr, int socket_fd, struct sockaddr_in client_address, socklen_t address_length, bool *connected){
+// New client gets a session, unless 'table' already holds the limit of sessions.
+// 'rest_len' bytes after CONN hold offered capabilities, then the first DATA package,
+// which is handled once the client is accepted.
+int CONN_handler(conn const *recv, char *rest, size_t rest_len, session_table *table, output *out,
+                 int socket_fd, struct sockaddr_in client_address, socklen_t address_length){
     base to_send;
-    if (!(*connected)){  // Server isn't currently holding any connection.
-        // Creating new connection,
-        if (recv.protocol == 3){
-            *udpr = true;
-        }
-        else if (recv.protocol != 2){  // Not UDP/UDPr.
+    session *s = session_find(table, recv->session_id);
+    if (s == NULL){  // Client isn't connected yet.
+        uint8_t protocol = recv->protocol & PROT_ID;
+        bool stream = (recv->protocol & PROT_STREAM) != 0;
+        bool ext = (recv->protocol & PROT_EXT) != 0;
+        bool with_data = (recv->protocol & PROT_EARLY) != 0;
+        size_t caps_len = ext ? capabilities_size(rest, rest_len) : 0;
+        if (protocol < 2 || protocol > 5 || (recv->protocol & ~(PROT_ID | PROT_STREAM | PROT_FEC | PROT_EARLY | PROT_EXT)) != 0 ||
+            ((recv->protocol & PROT_FEC) != 0 && protocol != 2) || (ext && (caps_len == 0 || caps_len > rest_len)) ||
+            (with_data && (protocol > 3 || (recv->protocol & PROT_FEC) != 0 ||
+                           !early_correct(recv, rest + caps_len, rest_len - caps_len, table->limits.payload)))){
+            // Not UDP/UDPr/UDPw/UDPn, unknown flags, FEC not on UDP, incomplete capabilities or data with CONN not on UDP/UDPr.
             fprintf(stderr, "ERROR: Client tried to connect using wrong protocol.\n");
             return 1;
         }
-        *sess_id = recv.session_id;
-        *unpack = recv.length;
-        create_base(&to_send, recv.session_id);  // CONNACC
-        if (send_pack(2, socket_fd, &to_send, sizeof(base), client_address, address_length) == 1){  // Sending assent for connection.
+        capabilities offer = {0};
+        if (ext){
+            read_capabilities(rest, &offer);
+        }
+        s = session_insert(table, recv->session_id);
+        if (s == NULL){  // Session limit reached.
+            fprintf(stderr, "ERROR: Too many clients, another client tried to connect.\n");
+            create_base(&to_send, recv->session_id);  // CONRJT.
+            if (send_pack(3, socket_fd, &to_send, sizeof(base), client_address, address_length) == 1){  // Sending CONRJT.
+                fprintf(stderr, "ERROR: Couldn't send CONRJT to that client.\n");
+            }
+            return 0;
+        }
+        // Creating new connection.
+        s->record.fd = -1;
+        s->udpr = protocol >= 3;
+        s->windowed = protocol == 4;
+        s->nack = protocol == 5;
+        s->fec = (recv->protocol & PROT_FEC) != 0;
+        s->ext = ext;
+        s->agreed = agree(&offer, &table->limits, s->windowed ? WINDOW : 0);
+        s->agreed.messages = stream ? s->agreed.messages : 0;  // Messages are framed in a stream only.
+        s->framed = s->agreed.messages != 0;
+        framer_init(&s->frames);
+        s->agreed.stripes = stream ? 0 : s->agreed.stripes;  // Ranges of a transfer have known lengths.
+        s->agreed.stripe = stream ? 0 : s->agreed.stripe;
+        if (stream || with_data || s->agreed.stripes != 0){  // Resumed transfer is a whole message, its first DATA comes after CONNACC.
+            s->agreed.resume = 0;
+            s->agreed.digest = 0;
+        }
+        s->max_payload = s->agreed.payload != 0 ? s->agreed.payload : table->limits.payload;
+        s->wait = (s->agreed.timeout != 0 ? s->agreed.timeout : table->limits.timeout) * 1000ULL;
+        if (s->fec){  // Block is held until its parity comes, if a package is lost.
+            s->parity = pool_get(&table->window);
+            fec_reset(&s->block, 0);
+        }
+        bool reorder = protocol == 2 && !s->fec && table->reorder > 0;  // Plain UDP packages may come out of order.
+        if ((s->windowed && session_span(s, s->agreed.window != 0 ? s->agreed.window : WINDOW) == 1) || (s->nack && session_span(s, NACK_WINDOW) == 1) ||
+            (s->fec && (s->parity == POOL_NONE || session_span(s, FEC_BLOCK) == 1)) ||
+            (reorder && session_span(s, table->reorder) == 1)){
+            to_default(table, s);
+            create_base(&to_send, recv->session_id);  // CONRJT.
+            if (send_pack(3, socket_fd, &to_send, sizeof(base), client_address, address_length) == 1){
+                fprintf(stderr, "ERROR: Couldn't send CONRJT to that client.\n");
+            }
+            return 1;
+        }
+        s->stream = stream;
+        s->unpack = s->stream ? UINT64_MAX : be64toh(recv->length);
+        if (s->agreed.stripes != 0){  // Transfer ID is the first part of session ID, which also keeps stripes on one worker.
+            uint32_t id;
+            memcpy(&id, &recv->session_id, sizeof(uint32_t));
+            s->stripe = s->agreed.stripe;
+            // Client without retransmissions can't be held back, so its range has to fit the buffers of a stripe.
+            bool fits = s->udpr || s->stripe == 0 || s->unpack <= (uint64_t) STRIPE_BUFFERS * BUFFOR_SIZE;
+            s->transfer = fits ? transfer_join(&table->transfers, id, s->agreed.stripes, s->stripe, s->unpack) : NULL;
+            if (s->transfer == NULL){
+                fprintf(stderr, "ERROR: Client's stripe doesn't fit its transfer.\n");
+                to_default(table, s);
+                create_base(&to_send, recv->session_id);  // CONRJT.
+                if (send_pack(3, socket_fd, &to_send, sizeof(base), client_address, address_length) == 1){
+                    fprintf(stderr, "ERROR: Couldn't send CONRJT to that client.\n");
+                }
+                return 1;
+            }
+        }
+        if (s->agreed.resume != 0){  // Data written by earlier sessions of the transfer isn't sent again.
+            if (checkpoint_open(&s->record, table->checkpoints, s->agreed.resume, s->agreed.digest, s->unpack, &s->resumed) == 1){
+                to_default(table, s);
+                create_base(&to_send, recv->session_id);  // CONRJT.
+                if (send_pack(3, socket_fd, &to_send, sizeof(base), client_address, address_length) == 1){
+                    fprintf(stderr, "ERROR: Couldn't send CONRJT to that client.\n");
+                }
+                return 1;
+            }
+            s->unpack -= s->resumed;
+        }
+        s->client = client_address;
+        s->sent_at = mono_us();
+        rtt_init(&s->timer, s->sent_at);
+        udp_deadline(table, s, s->sent_at);
+        if (send_conacc(s, socket_fd, client_address, address_length) == 1){  // Sending assent for connection.
             fprintf(stderr, "ERROR: Couldn't connect with the client.\n");
-            return 1;  // Disconnect user.
+            to_default(table, s);  // Disconnect user.
+            return 1;
+        }
+        if (s->record.fd >= 0 && s->unpack == 0){  // Earlier sessions wrote the whole message.
+            return udp_received(table, s, out, socket_fd, client_address, address_length);
+        }
+        if (with_data){  // Client didn't wait for CONNACC with its first DATA.
+            char *early = rest + caps_len;
+            data_msg const *data = (data_msg const *) (early + sizeof(uint8_t));
+            return DATA_handler(early + sizeof(uint8_t) + sizeof(data_msg), table, s, data, out,
+                                socket_fd, client_address, address_length);
         }
-        return 2;  // Connected to new client.
     }
-    else{  // Server was already connected with a client.
-        if (*sess_id != recv.session_id){
-            fprintf(stderr, "ERROR: Another client tried to connect.\n");
-            create_base(&to_send, recv.session_id);  // CONRJT.
-            if (send_pack(3, socket_fd, &to_send, sizeof(base), client_address, address_length) == 1){  // Sending CONRJT.
-                fprintf(stderr, "ERROR: Couldn't send another CONRJT that client.\n");
+    else if (!s->udpr){  // Connected to the user using UDP.
+        fprintf(stderr, "ERROR: Connected client sent another CONN. \n");
+        create_base(&to_send, recv->session_id);  // CONRJT
+        to_default(table, s);
+        if (send_pack(3, socket_fd, &to_send, sizeof(base), client_address, address_length) == 1){  // Sending CONRJT.
+            fprintf(stderr, "ERROR: Couldn't send CONRJT.\n");
+        }
+        return 1;
+    }
+    return 0;  // UDPR client retransmitted CONN, it is ignored.
+}
+
+
+// Handles clients whose timeout has passed.
+// UDPR clients get retransmission of the last confirmation, unless they are silent for too long.
+// UDP clients are disconnected after their timeout.
+void udp_timeouts(session_table *table, int socket_fd){
+    uint64_t now = mono_us();
+    table->next_sweep = UINT64_MAX;
+    size_t i = 0;
+    while (i < table->count){
+        session *s = &table->sessions[i];
+        if (s->deadline <= now){
+            if (s->udpr && !rtt_expired(&s->timer, now)){
+                s->trials++;  // Another trial.
+                rtt_backoff(&s->timer);
+                s->sent_at = now;
+                if (s->highest > 0 && s->nack){  // Some data received.
+                    if (send_nack(s, socket_fd, s->client, sizeof(s->client)) == 1){
+                        fprintf(stderr, "ERROR: Couldn't resend NACK.\n");
+                    }
+                }
+                else if (s->last > 0 && s->windowed){  // Some data received.
+                    if (send_window_ack(s, socket_fd, s->client, sizeof(s->client)) == 1){
+                        fprintf(stderr, "ERROR: Couldn't resend ACC.\n");
+                    }
+                }
+                else if (s->last > 0){  // Some data received.
+                    status to_send;  // ACC
+                    create_status(&to_send, s->sess_id, s->last - 1);
+                    if (send_pack(5, socket_fd, &to_send, sizeof(status), s->client, sizeof(s->client))){
+                        fprintf(stderr, "ERROR: Couldn't resend ACC.\n");
+                    }
+                }
+                else{  // No data received yet.
+                    if (send_conacc(s, socket_fd, s->client, sizeof(s->client)) == 1){
+                        fprintf(stderr, "ERROR: Couldn't resend CONNACC.\n");
+                    }
+                }
+                udp_deadline(table, s, now);
+            }
+            else if (!s->udpr && s->highest > s->last){  // Plain UDP client's package was lost.
+                fprintf(stderr, "ERROR: Missing package didn't come in time.\n");
+                status to_send;
+                create_status(&to_send, s->sess_id, s->last);  // RJT
+                if (send_pack(6, socket_fd, &to_send, sizeof(status), s->client, sizeof(s->client)) == 1){
+                    fprintf(stderr, "ERROR: Couldn't sent RJT.\n");
+                }
+                to_default(table, s);
+                continue;
+            }
+            else{  // Too many retransmissions or UDP client timeout.
+                fprintf(stderr, "ERROR: Message timeout.\n");
+                to_default(table, s);
+                continue;  // Last session was moved into 'i'.
+            }
+        }
+        else if (s->deadline < table->next_sweep){
+            table->next_sweep = s->deadline;
+        }
+        i++;
+    }
+}
+
+
+// Waits for the next package, but not longer than until the nearest timeout of a session.
+int udp_wait(int socket_fd, session_table *table){
+    struct timespec left = {0};
+    struct timespec *timeout = NULL;  // No clients, waiting for new connection lasts indefinitely.
+    if (table->count > 0 && table->next_sweep != UINT64_MAX){
+        uint64_t now = mono_us();
+        uint64_t wait = table->next_sweep > now ? table->next_sweep - now : 0;
+        left = (struct timespec) {.tv_sec = wait / 1000000, .tv_nsec = (wait % 1000000) * 1000};
+        timeout = &left;  // Microsecond timeouts of sessions aren't rounded up to whole milliseconds.
+    }
+    struct pollfd wait_fd = {.fd = socket_fd, .events = POLLIN};
+    if (ppoll(&wait_fd, 1, timeout, NULL) < 0 && errno != EINTR){
+        fprintf(stderr, "ERROR: Couldn't wait for messages.\n");
+        return 1;
+    }
+    return 0;
+}
+
+
+// Handles one received datagram, headers are decoded where they lie in 'buff'.
+void udp_dispatch(char *buff, size_t received_length, session_table *table, output *out, int socket_fd,
+                  struct sockaddr_in client_address, socklen_t address_length){
+    uint8_t id = buff[0];
+    if (id == 1 && received_length >= sizeof(uint8_t) + sizeof(conn)){  // CONN
+        size_t early = sizeof(uint8_t) + sizeof(conn);
+        CONN_handler((conn const *) (buff + sizeof(uint8_t)), buff + early, received_length - early, table, out,
+                     socket_fd, client_address, address_length);
+    }
+    else if (id == 4 && received_length >= sizeof(uint8_t) + sizeof(data_msg)){  // DATA.
+        data_msg const *received = (data_msg const *) (buff + sizeof(uint8_t));
+        session *s = session_find(table, received->session_id);
+        uint32_t byte_len = be32toh(received->byte_len);
+        // GRO segments lie next to each other, so a short one mustn't be read past its end.
+        if (s != NULL && byte_len <= s->max_payload && received_length >= sizeof(uint8_t) + sizeof(data_msg) + byte_len){
+            uint64_t now = mono_us();
+            rtt_progress(&s->timer, now);  // Client is alive.
+            udp_deadline(table, s, now);
+            DATA_handler(buff + sizeof(uint8_t) + sizeof(data_msg), table, s, received, out, socket_fd, client_address, address_length);
+        }
+        else{
+            status to_send;
+            create_status(&to_send, received->session_id, be64toh(received->pack_id));  // RJT
+            if (send_pack(6, socket_fd, &to_send, sizeof(status), client_address, address_length) == 1){ // Sends RJT.
+                fprintf(stderr, "ERROR: Couldn't sent RJT.\n");
+            }
+            if (s == NULL){
+                fprintf(stderr, "ERROR: Not connected client tried to send DATA package.\n");
+            }
+            else{
+                fprintf(stderr, "ERROR: Client sent package with incorrect size.\n");
+                to_default(table, s);
+            }
+        }
+    }
+    else if (id == 9 && received_length >= sizeof(uint8_t) + sizeof(parity_msg)){  // PARITY.
+        parity_msg const *received = (parity_msg const *) (buff + sizeof(uint8_t));
+        session *s = session_find(table, received->session_id);
+        uint32_t byte_len = be32toh(received->byte_len);
+        if (s != NULL && s->fec && byte_len <= s->max_payload &&
+            received_length >= sizeof(uint8_t) + sizeof(parity_msg) + byte_len){
+            udp_deadline(table, s, mono_us());
+            PARITY_handler(buff + sizeof(uint8_t) + sizeof(parity_msg), table, s, received, out, socket_fd, client_address, address_length);
+        }
+        else if (s != NULL){
+            fprintf(stderr, "ERROR: Client sent incorrect PARITY package.\n");
+            to_default(table, s);
+        }
+    }
+    else{  // Wrong ID package or incomplete package.
+        fprintf(stderr, "ERROR: Incorrect package ID received.\n");
+        if (received_length >= sizeof(uint8_t) + sizeof(base)){
+            session *s = session_find(table, ((base const *) (buff + sizeof(uint8_t)))->session_id);
+            if (s != NULL){
+                to_default(table, s);  // Disconnecting user.
+            }
+        }
+    }
+}
+
+
+// Receive slots of datagrams read with one syscall.
+typedef struct udp_batch{
+    struct mmsghdr *headers;
+    struct iovec *iovecs;
+    struct sockaddr_in *addresses;
+    char *buffers;           // 'size' buffers of 'SLOT_SIZE' bytes.
+    char *controls;          // UDP_GRO control message of every slot, NULL without GRO.
+    size_t size;             // Number of slots.
+    uint64_t batches;        // Number of non-empty batches received.
+    uint64_t packages;       // Number of slots filled in them.
+    uint64_t datagrams;      // Number of datagrams in the slots, more than slots if GRO merged them.
+} udp_batch;
+
+// Merged datagrams fill at most one UDP packet, longer than any single package.
+#define SLOT_SIZE (1 << 16)
+#define SLOT_CONTROL CMSG_SPACE(sizeof(int))
+
+
+// Allocates batch of 'size' receive slots, with room for segment sizes of merged datagrams if 'gro'.
+int batch_init(udp_batch *batch, size_t size, bool gro){
+    batch->headers = calloc(size, sizeof(struct mmsghdr));
+    batch->iovecs = calloc(size, sizeof(struct iovec));
+    batch->addresses = calloc(size, sizeof(struct sockaddr_in));
+    batch->buffers = malloc(size * SLOT_SIZE);
+    batch->controls = gro ? calloc(size, SLOT_CONTROL) : NULL;
+    if (malloc_error(batch->headers) == 1 || malloc_error(batch->iovecs) == 1 ||
+        malloc_error(batch->addresses) == 1 || malloc_error(batch->buffers) == 1 ||
+        (gro && malloc_error(batch->controls) == 1)){
+        free(batch->headers);
+        free(batch->iovecs);
+        free(batch->addresses);
+        free(batch->buffers);
+        free(batch->controls);
+        return 1;
+    }
+    for (size_t i = 0; i < size; i++){
+        batch->iovecs[i].iov_base = batch->buffers + i * SLOT_SIZE;
+        batch->iovecs[i].iov_len = SLOT_SIZE;
+        batch->headers[i].msg_hdr.msg_iov = &batch->iovecs[i];
+        batch->headers[i].msg_hdr.msg_iovlen = 1;
+        batch->headers[i].msg_hdr.msg_name = &batch->addresses[i];
+    }
+    batch->size = size;
+    batch->batches = 0;
+    batch->packages = 0;
+    batch->datagrams = 0;
+    return 0;
+}
+
+
+// Frees batch memory.
+void batch_free(udp_batch *batch){
+    free(batch->headers);
+    free(batch->iovecs);
+    free(batch->addresses);
+    free(batch->buffers);
+    free(batch->controls);
+}
+
+
+// Receives up to 'size' datagrams. Returns their number, 0 if there were none, -1 on error.
+int batch_receive(int socket_fd, udp_batch *batch){
+    for (size_t i = 0; i < batch->size; i++){  // Address and control lengths are overwritten by every receive.
+        batch->headers[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+        if (batch->controls != NULL){
+            batch->headers[i].msg_hdr.msg_control = batch->controls + i * SLOT_CONTROL;
+            batch->headers[i].msg_hdr.msg_controllen = SLOT_CONTROL;
+        }
+    }
+    int received = recvmmsg(socket_fd, batch->headers, batch->size, MSG_DONTWAIT, NULL);
+    if (received < 0){
+        if (errno == EAGAIN || errno == EWOULDBLOCK){
+            return 0;
+        }
+        fprintf(stderr, "ERROR: Couldn't receive message.\n");
+        return -1;
+    }
+    batch->batches++;
+    batch->packages += received;
+    return received;
+}
+
+
+// Size of datagrams merged in slot 'i', its whole length if it holds one datagram.
+size_t batch_segment(udp_batch const *batch, int i){
+    struct msghdr const *header = &batch->headers[i].msg_hdr;
+    size_t len = batch->headers[i].msg_len;
+    if (batch->controls == NULL){
+        return len;
+    }
+    for (struct cmsghdr *control = CMSG_FIRSTHDR(header); control != NULL; control = CMSG_NXTHDR((struct msghdr *) header, control)){
+        if (control->cmsg_level == SOL_UDP && control->cmsg_type == UDP_GRO){
+            int segment;
+            memcpy(&segment, CMSG_DATA(control), sizeof(int));
+            if (segment > 0 && (size_t) segment < len){
+                return segment;
+            }
+        }
+    }
+    return len;
+}
+
+
+//  UDP server lifetime.
+//  Clients are served concurrently, data of each package is written to stdout as a whole.
+//  Datagrams are received in batches, whole batch is handled before the next syscall
+//  and its data is written to stdout together. With GRO the kernel merges datagrams
+//  of a client into one slot, they are handled one by one as if received separately.
+int udp_server(int socket_fd, server_config const *config){
+    session_table table;  // Sessions of connected clients.
+    udp_batch batch;      // Receive slots.
+    // Kernels without GRO reject the option, datagrams then come one per slot.
+    bool gro = config->gro && setsockopt(socket_fd, SOL_UDP, UDP_GRO, &(int){1}, sizeof(int)) == 0;
+    if (batch_init(&batch, config->batch, gro) == 1){
+        return 1;
+    }
+    if (sessions_init(&table, config->max_sessions, config->window_buffers) == 1){
+        batch_free(&batch);
+        return 1;
+    }
+    table.reorder = config->reorder;
+    table.limits.payload = config->payload;
+    table.limits.timeout = config->timeout;
+    table.limits.resume = config->checkpoints >= 0;
+    table.checkpoints = config->checkpoints;
+    uint64_t next_report = mono_us() + STATS_INTERVAL * 1000000ULL;
+    output out;  // Data of the batch waiting for stdout.
+    output_init(&out, OUTPUT_THRESHOLD, &output_lock);
+    table.out = &out;
+
+    // Handling clients.
+    for (;;) {
+        int received = batch_receive(socket_fd, &batch);
+        if (received == 0){  // Nothing to read, waiting for next package.
+            if (udp_wait(socket_fd, &table) == 1){
+                break;
             }
         }
-        else if (!*udpr){  // Connected to the user using UDP.
-            fprintf(stderr, "ERROR: Connected client sent another CONN. \n");
-            create_base(&to_send, recv.session_id);  // CONRJT
-            if (send_pack(3, socket_fd, &to_send, sizeof(base), client_address, address_length) == 1){  // Sending CONRJT.
-                fprintf(stderr, "ERROR: Couldn't send CONRJT.\n");
-            }
+        for (int i = 0; i < received; i++){  // Got messages.
+            char *slot = batch.iovecs[i].iov_base;
+            size_t len = batch.headers[i].msg_len;
+            size_t segment = batch_segment(&batch, i);
+            size_t offset = 0;
+            do{  // Empty datagram is handled too.
+                size_t segment_len = len - offset < segment ? len - offset : segment;
+                udp_dispatch(slot + offset, segment_len, &table, &out, socket_fd,
+                             batch.addresses[i], batch.headers[i].msg_hdr.msg_namelen);
+                batch.datagrams++;
+                offset += segment;
+            } while (offset < len);
+        }
+        bool written = output_flush(&out) == 0 && !out.failed;  // Receive slots are reused by the next batch.
+        udp_done(&table, socket_fd, written);  // Messages are confirmed once written.
+        out.failed = false;
+        uint64_t now = mono_us();
+        if (now >= table.next_sweep){  // Some client might have timed out.
+            udp_timeouts(&table, socket_fd);
+        }
+        // Reported periodically and whenever server becomes idle.
+        if (config->stats && batch.batches > 0 && (now >= next_report || table.count == 0)){
+            fprintf(stderr, "STATS: %" PRIu64 " batches, average fill %.2f of %zu, %.2f datagrams per slot, %" PRIu64 " writes.\n",
+                    batch.batches, (double) batch.packages / batch.batches, batch.size,
+                    (double) batch.datagrams / batch.packages, out.writes);
+            out.writes = 0;
+            batch.batches = 0;
+            batch.packages = 0;
+            batch.datagrams = 0;
+            next_report = now + STATS_INTERVAL * 1000000ULL;
+        }
+    }
+    sessions_free(&table);
+    batch_free(&batch);
+    return 1;
+}
+
+
+// State of one TCP client.
+typedef struct tcp_client{
+    int fd;                  // Client's socket.
+    size_t index;            // Position in the array of clients.
+    bool conacc;             // Accepted connection from the client.
+    bool header;             // Header of the current DATA package was read.
+    bool stream;             // Length is unknown, message ends with an empty DATA.
+    bool framed;             // Stream carries messages, each confirmed with DONE once written. Their data isn't spliced.
+    framer frames;           // Messages of framed stream.
+    uint64_t confirmed;      // Messages confirmed with DONE.
+    transfer *transfer;      // Striped transfer the client sends a range of, NULL if it sends a whole message. Its data isn't spliced.
+    uint32_t stripe;         // Index of its range.
+    bool parked;             // Stripe has no room for the current DATA, the socket isn't read until it has.
+    checkpoint record;       // Progress of resumable transfer.
+    uint64_t sess_id;        // Client's session ID.
+    uint64_t size;           // Size left of client's message.
+    uint64_t pack_id;        // ID of next package.
+    uint64_t deadline;       // Monotonic time (us) of the timeout.
+    uint64_t length;         // Size of client's whole message.
+    uint32_t payload;        // Data size of the current DATA package.
+    uint32_t max_payload;    // Max data size of DATA.
+    uint64_t wait;           // Time (us) without data after which the client is disconnected.
+    uint64_t reads;          // Read syscalls.
+    uint64_t writes;         // Write syscalls.
+    ring input;              // Received bytes, not handled yet.
+} tcp_client;
+
+
+// Clients connected to TCP server.
+typedef struct tcp_clients{
+    tcp_client **clients;    // Dense array of 'count' clients.
+    size_t count;            // Number of connected clients.
+    size_t limit;            // Max number of connected clients.
+    uint64_t next_sweep;     // No client times out before that time (us).
+    bool splice;             // Data goes from sockets to stdout through 'pipe_fds'.
+    int pipe_fds[2];         // Pipe for splicing, empty between splices.
+    char *fallback;          // Buffer for data left in the pipe when stdout can't be spliced to.
+    capabilities limits;     // Most the server agrees to, limits of clients which don't negotiate too.
+    transfers transfers;     // Striped transfers, ranges sent by connected clients.
+    pool held;               // Buffers of stripes behind the head of their transfers.
+    size_t parked;           // Number of parked clients.
+    int epoll_fd;            // Watches sockets of the clients which aren't parked.
+    int checkpoints;         // Directory of records of resumable transfers, -1 if transfers aren't resumed.
+} tcp_clients;
+
+
+// Sets new timeout of the client.
+void tcp_deadline(tcp_clients *all, tcp_client *client, uint64_t deadline){
+    client->deadline = deadline;
+    if (deadline < all->next_sweep){
+        all->next_sweep = deadline;
+    }
+}
+
+
+// Stops reading from the client until its stripe has room for the current DATA.
+// Time spent waiting for other stripes doesn't count to its timeout.
+void tcp_park(tcp_clients *all, tcp_client *client){
+    struct epoll_event event = {.events = 0, .data.ptr = client};
+    if (epoll_ctl(all->epoll_fd, EPOLL_CTL_MOD, client->fd, &event) < 0){
+        fprintf(stderr, "ERROR: Couldn't watch the client.\n");
+    }
+    client->parked = true;
+    client->deadline = UINT64_MAX;
+    all->parked++;
+}
+
+
+// Disconnecting client from the server.
+// Its striped transfer fails unless the range is whole, record of resumable transfer already has the data written.
+void tcp_disconnect(tcp_clients *all, tcp_client *client){
+    all->parked -= client->parked;
+    if (client->record.fd >= 0){
+        checkpoint_close(&client->record);
+    }
+    if (client->transfer != NULL){
+        transfer_leave(&all->transfers, client->transfer, client->stripe);
+    }
+    close(client->fd);  // Also removes the socket from epoll.
+    all->count--;
+    all->clients[client->index] = all->clients[all->count];
+    all->clients[client->index]->index = client->index;
+    ring_free(&client->input);
+    free(client);
+}
+
+
+// Sends package with given ID to the client.
+int tcp_send_pack(int socket_fd, uint8_t id, void *pack, size_t size){
+    struct iovec parts[2] = {
+        {.iov_base = &id, .iov_len = sizeof(uint8_t)},
+        {.iov_base = pack, .iov_len = size},  // CONNACC with capabilities is longer than a status.
+    };
+    // Socket is non-blocking, but small package fits into an empty send buffer.
+    return tcp_writev(socket_fd, parts, 2);
+}
+
+
+// Passes data of complete DATA package to the output, straight from the ring.
+// Ring space is reused only after the output is flushed.
+int tcp_data(tcp_client *client, uint32_t len, output *out){
+    struct iovec parts[2];
+    int count = ring_parts(&client->input, 0, len, parts);
+    for (int i = 0; i < count; i++){
+        int code;
+        if (client->transfer != NULL){
+            code = transfer_push(client->transfer, client->stripe, out, parts[i].iov_base, parts[i].iov_len);
+        }
+        else{
+            code = output_push(out, parts[i].iov_base, parts[i].iov_len);
+        }
+        if (client->framed){
+            framer_scan(&client->frames, parts[i].iov_base, parts[i].iov_len);
+        }
+        if (code == 1){
             return 1;
         }
     }
+    client->input.head += len;
+    client->size -= len;  // Lessens size of data to read.
     return 0;
 }
 
 
-//  UDP server lifetime.
-int udp_server(int socket_fd){
-    uint64_t sess_id = 0;  // Session ID of currently connected client.
-    uint64_t unpack = 0;  // Number of bites left to receive.
-    uint64_t last = 0;  // ID of last received package.
-    uint64_t trials = 0;
-    struct sockaddr_in client;
-    bool connected = false;  // User connected.
-    bool udpr = false;  // User uses UDPR.
-
-    // Handling clients.
-    for (;;) {
-        static char buff[BUFFOR_SIZE + sizeof(data_msg) + sizeof(uint8_t)];  // Buffer for protocol ID.
-        struct sockaddr_in client_address;
-        socklen_t address_length = (socklen_t) sizeof(client_address);
-        ssize_t received_length = recvfrom(socket_fd, buff, sizeof(data_msg) + BUFFOR_SIZE + sizeof(uint8_t), 0,
-                                           (struct sockaddr *) &client_address, &address_length);
-        if (received_length < 0) {
-            // If there is udpr client connected but no message has been received in 'MAX_WAIT' seconds.
-            if (udpr && errno == EAGAIN){
-                if (trials < MAX_RETRANSMITS){
-                    trials++;  // Another trial.
-                    if (last > 0){  // Some data received.
-                        status to_send;  // ACC
-                        create_status(&to_send, sess_id, last - 1);
-                        if (send_pack(5, socket_fd, &to_send, sizeof(status), client, sizeof(client))){
-                            fprintf(stderr, "ERROR: Couldn't resend ACC.\n");
-                        }
-                    }
-                    else{  // No data received yet.
-                        base to_send;
-                        create_base(&to_send, sess_id);
-                        if (send_pack(2, socket_fd, &to_send, sizeof(base), client, sizeof(client))){
-                            fprintf(stderr, "ERROR: Couldn't resend CONNACC.\n");
-                        }
-                    }
-                }
-                else{  // Too many retransmissions.
-                    fprintf(stderr, "ERROR: Message timeout.\n");
-                    to_default(&last, &udpr, &trials, &connected);
-                }
-
-            }
-            // If there was an error receiving the message.
-            else if (errno != EAGAIN){
-                fprintf(stderr, "ERROR: Couldn't receive message.\n");
-                if (!udpr && connected){  // If client wasn't using UDP.
-                    to_default(&last, &udpr, &trials, &connected);  // Disconnect.
-                }
-            }
-            // User with no UDP timeout.
-            else if (errno == EAGAIN && connected){
-                fprintf(stderr, "ERROR: Message timeout.\n");
-                to_default(&last, &udpr, &trials, &connected);
-            }
-        }
-        else{  // Got message.
-            uint8_t id;
-            memcpy(&id, buff, sizeof(uint8_t));
-            if (id == 1){  // CONN
-                conn received;
-                memcpy(&received, buff + sizeof(uint8_t), sizeof(conn));
-                received.session_id = received.session_id;
-                received.length = be64toh(received.length);
-                int conn = CONN_handler(received, &sess_id, &unpack, &udpr, socket_fd, client_address, address_length, &connected);
-
-                if (conn == 1){  // CONN error.
-                    fprintf(stderr, "ERROR: Ending connection with current client.\n");
-                    to_default(&last, &udpr, &trials, &connected);
-                }
-                else if (conn == 2){  // New user connected.
-                    client = client_address;
-                    connected = true;
-                }
-            }
-            else if (id == 4){  // DATA.
-                data_msg received;
-                memcpy(&received, buff + sizeof(uint8_t), sizeof(data_msg));
-                received.session_id = received.session_id;
-                received.pack_id = be64toh(received.pack_id);
-                received.byte_len = be32toh(received.byte_len);
-                if (connected && sess_id == received.session_id && received.byte_len <= BUFFOR_SIZE){
-                    char* msg = malloc(received.byte_len);
-                    if (malloc_error(msg) == 0){
-                        memcpy(msg, buff + sizeof(data_msg) + sizeof(uint8_t), received.byte_len);
-                        DATA_handler(msg, &unpack, &last, &udpr, &connected, &trials, received, socket_fd, client_address, address_length);
-                        free(msg);
-                    }
-                }
-                else{
-                    status to_send;
-                    create_status(&to_send, received.session_id, received.pack_id);  // RJT
-                    if (send_pack(6, socket_fd, &to_send, sizeof(status), client_address, address_length) == 1){ // Sends RJT.
-                        fprintf(stderr, "ERROR: Couldn't sent RJT.\n");
-                    }
-                    if (!connected){
-                        fprintf(stderr, "ERROR: Not connected user tried to send a package.\n");
-                    }
-                    else if (sess_id != received.session_id){
-                        fprintf(stderr, "ERROR: Not connected client tried to send DATA package.\n");
-                    }
-                    else{
-                        fprintf(stderr, "ERROR: Client sent package with incorrect size.\n");
-                        to_default(&last, &udpr, &trials, &connected);
-                    }
-                }
+// Finishes DATA package whose data was handled.
+// Whole message is confirmed with RCVD, whole range of a stripe with PART unless it completes the transfer.
+// Returns 0 if client should send more, 1 on error and 2 if whole message was read.
+int tcp_finish(tcp_client *client, output *out, server_config const *config){
+    client->header = false;
+    client->pack_id++;
+    if (client->size == 0){  // If whole message was read.
+        client->writes += out->count > 0;
+        if (output_flush(out) == 1 || out->failed){  // Everything has to be written before RCVD.
+            return 1;
+        }
+        if (client->framed && !framer_whole(&client->frames)){
+            fprintf(stderr, "ERROR: Session ended inside a message.\n");
+            return 1;
+        }
+        uint8_t id = 7;
+        if (client->transfer != NULL){
+            if (transfer_whole(client->transfer, client->stripe, out) == 1){  // Ranges held behind this one are written.
+                return 1;
             }
-            else{  // Currently connected client with wrong ID package.
-                fprintf(stderr, "ERROR: Incorrect package ID received.\n");
-                to_default(&last, &udpr, &trials, &connected);  // Disconnecting user.
+            id = transfer_done(client->transfer) ? 7 : 11;
+        }
+        if (client->record.fd >= 0){  // Later transfers of the message are only confirmed.
+            checkpoint_finish(&client->record);
+        }
+        if (client->framed && client->frames.messages > client->confirmed){  // DONE of all messages comes before RCVD.
+            status done;
+            create_status(&done, client->sess_id, client->frames.messages);
+            if (tcp_send_pack(client->fd, 10, &done, sizeof(status)) == 1){
+                fprintf(stderr, "ERROR: Couldn't send DONE.\n");
+                return 1;
             }
+            client->confirmed = client->frames.messages;
+        }
+        if (config->stats && client->length > 0){
+            double megabytes = client->length / 1e6;
+            fprintf(stderr, "STATS: %.2f reads, %.2f writes per MB.\n", client->reads / megabytes, client->writes / megabytes);
         }
+        base rcvd;
+        create_base(&rcvd, client->sess_id);
+        if (tcp_send_pack(client->fd, id, &rcvd, sizeof(base)) == 1){  // Send RCVD or PART.
+            fprintf(stderr, "ERROR: Couldn't send recv\n");
+        }
+        return 2;
     }
     return 0;
 }
 
 
-// Disconnecting currently connected user from the server.
-void tcp_disconnect(bool *connected, bool *conacc, uint64_t *pack_id, int socket_fd){
-    *connected = false;
-    *conacc = false;
-    *pack_id = 0;
-    close(socket_fd);
-}
-
-
-// Reads data.
-int tcp_data(int socket_fd, uint32_t len, uint64_t *size){
-    char* buffer = malloc(len);
-    if (malloc_error(buffer) == 1){
-        return 1;
+// Size of CONN with its capabilities at the head of 'input', as far as the received bytes tell.
+size_t tcp_conn_size(ring *input){
+    char pack[sizeof(uint8_t) + sizeof(conn) + sizeof(uint8_t)];
+    size_t size = sizeof(uint8_t) + sizeof(conn);
+    if (ring_used(input) < size){
+        return size;
     }
-    if (tcp_read(socket_fd, buffer, len) == 1){  // Gets data to write.
-        free(buffer);
-        return 1;
+    ring_peek(input, 0, pack, size);
+    if ((((conn const *) (pack + sizeof(uint8_t)))->protocol & PROT_EXT) == 0){
+        return size;
     }
-    if (write(STDOUT_FILENO, buffer, len) < 0){  // Writes data on stdout.
-        fflush(stdout);
-        free(buffer);
-        fprintf(stderr, "ERROR: Couldn't write received message.\n");
-        return 1;
+    if (ring_used(input) < size + sizeof(uint8_t)){  // Count of capabilities.
+        return size + sizeof(uint8_t);
     }
-    fflush(stdout);
-    *size -= len;  // Lessens size of data to read.
-    free(buffer);
-    return 0;
+    ring_peek(input, size, pack + size, sizeof(uint8_t));
+    return size + capabilities_size(pack + size, sizeof(uint8_t));
 }
 
 
-// Handles getting new packages. Size is a pointer to size left of message.
-// Demanded is the ID of package that server wants to recieve. Pack_id is the id of next package with data to recieve.
-int tcp_handle(int socket_fd, uint64_t *sess_id, uint64_t *size, uint8_t demanded, uint64_t pack_id){
-    uint8_t pack;
-    if (tcp_read(socket_fd, &pack, sizeof(uint8_t)) == 1){  // Reads new package information.
-        return 1;
-    }
-    if (demanded == pack){  // ID of received package matches demanded ID.
-        if (demanded == 1){  // CONN.
-            conn received;
-            if (tcp_read(socket_fd, &received, sizeof(conn)) == 1){  // Reads new package information.
+// Handles all complete packages in the ring.
+// Returns 0 if client should send more, 1 on error and 2 if whole message was read.
+int tcp_parse(tcp_clients *all, tcp_client *client, output *out, server_config const *config){
+    for (;;){
+        size_t used = ring_used(&client->input);
+        if (!client->conacc){  // CONN, with capabilities offered by the client.
+            char pack[sizeof(uint8_t) + sizeof(conn) + sizeof(uint8_t) + UINT8_MAX * sizeof(capability)];
+            size_t size = tcp_conn_size(&client->input);
+            if (used < size){
+                return 0;
+            }
+            ring_peek(&client->input, 0, pack, size);
+            client->input.head += size;
+            if (pack[0] != 1){
+                fprintf(stderr, "ERROR: Wrong package id.\n");
                 return 1;
             }
-            if (received.protocol != 1){  // Not TCP.
+            conn const *received = (conn const *) (pack + sizeof(uint8_t));
+            if ((received->protocol & PROT_ID) != 1 || (received->protocol & ~(PROT_ID | PROT_STREAM | PROT_EXT)) != 0){  // Not TCP.
                 fprintf(stderr, "ERROR: Wrong protocol.\n");
                 return 1;
             }
-            else{  // Connected new user succesfully.
-                *sess_id = received.session_id;
-                *size = be64toh(received.length);
+            // Connected new user succesfully.
+            client->sess_id = received->session_id;
+            client->stream = (received->protocol & PROT_STREAM) != 0;
+            client->size = client->stream ? UINT64_MAX : be64toh(received->length);
+            client->length = client->size;
+            char acc[sizeof(base) + CAPS_SIZE + sizeof(uint64_t)];
+            create_base((base *) acc, client->sess_id);
+            size_t acc_size = sizeof(base);
+            if ((received->protocol & PROT_EXT) != 0){  // Agreed capabilities follow CONACC.
+                capabilities offer;
+                read_capabilities(pack + sizeof(uint8_t) + sizeof(conn), &offer);
+                capabilities agreed = agree(&offer, &all->limits, 0);
+                agreed.messages = client->stream ? agreed.messages : 0;  // Messages are framed in a stream only.
+                client->framed = agreed.messages != 0;
+                agreed.stripes = client->stream ? 0 : agreed.stripes;  // Ranges of a transfer have known lengths.
+                agreed.stripe = client->stream ? 0 : agreed.stripe;
+                if (agreed.stripes != 0){  // Transfer ID is the first part of session ID.
+                    uint32_t id;
+                    memcpy(&id, &client->sess_id, sizeof(uint32_t));
+                    client->stripe = agreed.stripe;
+                    client->transfer = transfer_join(&all->transfers, id, agreed.stripes, client->stripe, client->size);
+                    if (client->transfer == NULL){
+                        fprintf(stderr, "ERROR: Client's stripe doesn't fit its transfer.\n");
+                        base rjt;
+                        create_base(&rjt, client->sess_id);
+                        if (tcp_send_pack(client->fd, 3, &rjt, sizeof(base)) == 1){  // Send CONRJT.
+                            fprintf(stderr, "ERROR: Couldn't send CONRJT.\n");
+                        }
+                        return 1;
+                    }
+                }
+                if (client->stream || agreed.stripes != 0){  // Resumed transfer is a whole message.
+                    agreed.resume = 0;
+                    agreed.digest = 0;
+                }
+                uint64_t offset = 0;
+                if (agreed.resume != 0 && checkpoint_open(&client->record, all->checkpoints, agreed.resume, agreed.digest,
+                                                          client->size, &offset) == 1){
+                    base rjt;
+                    create_base(&rjt, client->sess_id);
+                    if (tcp_send_pack(client->fd, 3, &rjt, sizeof(base)) == 1){  // Send CONRJT.
+                        fprintf(stderr, "ERROR: Couldn't send CONRJT.\n");
+                    }
+                    return 1;
+                }
+                client->size -= offset;  // Data written by earlier sessions of the transfer isn't sent again.
+                client->length = client->size;
+                client->max_payload = agreed.payload != 0 ? agreed.payload : client->max_payload;
+                client->wait = agreed.timeout != 0 ? agreed.timeout * 1000ULL : client->wait;
+                acc_size += write_capabilities(acc + sizeof(base), &agreed);
+                if (agreed.resume != 0){  // Offset to resume at.
+                    offset = htobe64(offset);
+                    memcpy(acc + acc_size, &offset, sizeof(uint64_t));
+                    acc_size += sizeof(uint64_t);
+                }
             }
-        }
-        else{  // DATA.
-            data_msg received;
-            if (tcp_read(socket_fd, &received, sizeof(data_msg)) == 1){  // Reads new package information.
+            if (tcp_send_pack(client->fd, 2, acc, acc_size) == 1){  // Send CONACC.
+                fprintf(stderr, "ERROR: Couldn't send CONACC\n");
                 return 1;
             }
-            received.pack_id = be64toh(received.pack_id);
-            received.byte_len = be32toh(received.byte_len);
-            if (*sess_id == received.session_id && pack_id == received.pack_id && received.byte_len <= BUFFOR_SIZE && received.byte_len <= *size){
-                if (tcp_data(socket_fd, received.byte_len, size) == 1){  // Handles newly received data.
-                    return 1;
-                }
+            client->conacc = true;
+            if (client->record.fd >= 0 && client->size == 0){  // Earlier sessions wrote the whole message.
+                return tcp_finish(client, out, config);
+            }
+        }
+        else if (!client->header){  // Header of DATA.
+            char pack[sizeof(uint8_t) + sizeof(data_msg)];
+            if (used < sizeof(pack)){
                 return 0;
             }
-            else{  // DATA but with wrong parameters.
-                if (*sess_id != received.session_id){  // Incorrect session ID.
+            ring_peek(&client->input, 0, pack, sizeof(pack));  // Header may wrap around the ring.
+            client->input.head += sizeof(pack);
+            if (pack[0] != 4){
+                fprintf(stderr, "ERROR: Wrong package id.\n");
+                return 1;
+            }
+            data_msg const *received = (data_msg const *) (pack + sizeof(uint8_t));
+            uint64_t pack_id = be64toh(received->pack_id);
+            uint32_t byte_len = be32toh(received->byte_len);
+            if (client->sess_id != received->session_id || client->pack_id != pack_id ||
+                byte_len > client->max_payload || byte_len > client->size){  // DATA but with wrong parameters.
+                if (client->sess_id != received->session_id){  // Incorrect session ID.
                     fprintf(stderr, "ERROR: Wrong session id in DATA package.\n");
                 }
-                else if (pack_id != received.pack_id){  // Incorrect pack ID.
+                else if (client->pack_id != pack_id){  // Incorrect pack ID.
                     fprintf(stderr, "ERROR: Wrong data id in DATA package.\n");
                 }
                 else{
                     fprintf(stderr, "ERROR: Client sent data package with incorrect size.\n");
                 }
-                static char to_send[sizeof(uint8_t) + sizeof(status)];
-                uint8_t id = 6;
                 status rjt;
-                create_status(&rjt, received.session_id, received.pack_id);
-                memcpy(to_send, &id, sizeof(uint8_t));
-                memcpy(to_send + sizeof(uint8_t), &rjt, sizeof(status));
-                if (tcp_write(socket_fd, to_send, sizeof(uint8_t) + sizeof(status)) == 1){  // Send RJT
+                create_status(&rjt, received->session_id, pack_id);
+                if (tcp_send_pack(client->fd, 6, &rjt, sizeof(status)) == 1){  // Send RJT
                     fprintf(stderr, "ERROR: Couldn't send RJT.\n");
                 }
                 return 1;
             }
+            client->header = true;
+            client->payload = byte_len;
+            if (client->stream && byte_len == 0){  // End of the stream.
+                client->length = UINT64_MAX - client->size;
+                client->size = 0;
+            }
+        }
+        else{  // Data of DATA.
+            if (client->payload > 0 && all->splice && !client->framed && client->transfer == NULL){  // Only data already in the ring is handled here, rest is spliced.
+                uint32_t part = used < client->payload ? used : client->payload;
+                if (part > 0 && tcp_data(client, part, out) == 1){
+                    return 1;
+                }
+                client->payload -= part;
+                if (client->payload > 0){
+                    return 0;
+                }
+            }
+            else{
+                if (used < client->payload){
+                    return 0;
+                }
+                if (client->transfer != NULL && !transfer_room(client->transfer, client->stripe, client->payload)){
+                    tcp_park(all, client);
+                    return 0;
+                }
+                if (tcp_data(client, client->payload, out) == 1){  // Handles newly received data.
+                    return 1;
+                }
+            }
+            int code = tcp_finish(client, out, config);
+            if (code != 0){
+                return code;
+            }
+        }
+    }
+}
+
+
+// Writes 'len' bytes waiting in the pipe to stdout.
+// If stdout can't be spliced to, they are copied and splicing is turned off.
+int tcp_drain(tcp_clients *all, size_t len){
+    while (len > 0){
+        ssize_t moved = splice(all->pipe_fds[0], NULL, STDOUT_FILENO, NULL, len, SPLICE_F_MOVE);
+        if (moved < 0 && errno == EINVAL){  // Stdout doesn't support splice.
+            all->splice = false;
+            if (tcp_read(all->pipe_fds[0], all->fallback, len) == 1 || tcp_write(STDOUT_FILENO, all->fallback, len) == 1){
+                fprintf(stderr, "ERROR: Couldn't write received message.\n");
+                return 1;
+            }
+            return 0;
         }
+        if (moved <= 0){
+            fprintf(stderr, "ERROR: Couldn't write received message.\n");
+            return 1;
+        }
+        len -= moved;
     }
-    else{  // Received ID doesn't match demanded ID.
-        fprintf(stderr, "ERROR: Wrong package id.\n");
+    return 0;
+}
+
+
+// Moves data of the current DATA package from the socket to stdout through the pipe,
+// so the data is never copied to user space. Data reaches stdout before the package is complete.
+// Returns 0 if the socket is drained, 1 on error and 3 if the package is complete.
+int tcp_splice(tcp_clients *all, tcp_client *client, output *out){
+    client->writes += out->count > 0;
+    if (output_flush(out) == 1){  // Data which came earlier is written first.
         return 1;
     }
-    return 0;
+    while (client->payload > 0){
+        ssize_t moved = splice(client->fd, NULL, all->pipe_fds[1], NULL, client->payload, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        client->reads++;
+        if (moved < 0){
+            if (errno == EAGAIN || errno == EWOULDBLOCK){  // Pipe is empty, so the socket is.
+                return 0;
+            }
+            fprintf(stderr, "ERROR: Couldn't read message.\n");
+            return 1;
+        }
+        else if (moved == 0){
+            fprintf(stderr, "ERROR: Client already closed the socket.\n");
+            return 1;
+        }
+        tcp_deadline(all, client, mono_us() + client->wait);
+        client->payload -= moved;
+        client->size -= moved;  // Lessens size of data to read.
+        client->writes++;
+        if (tcp_drain(all, moved) == 1){
+            return 1;
+        }
+        if (client->record.fd >= 0){  // Progress is recorded once written.
+            checkpoint_save(&client->record, client->record.length - client->size);
+        }
+        if (!all->splice){  // Rest of the data goes through the ring.
+            return 0;
+        }
+    }
+    return 3;
 }
 
 
+// Handles packages in the ring, writes their data and confirms the messages written.
+// Returns 0 if client should send more, 1 on error and 2 if whole message was read.
+int tcp_progress(tcp_clients *all, tcp_client *client, output *out, server_config const *config){
+    int code = tcp_parse(all, client, out, config);
+    client->writes += out->count > 0;
+    if (output_flush(out) == 1 || out->failed){  // Data of all packages in this read is written at once.
+        return 1;
+    }
+    if (client->record.fd >= 0){  // Progress is recorded once written.
+        checkpoint_save(&client->record, client->record.length - client->size);
+    }
+    if (code == 0 && client->frames.messages > client->confirmed){  // Written messages are confirmed, the last ones by tcp_finish.
+        status done;
+        create_status(&done, client->sess_id, client->frames.messages);
+        if (tcp_send_pack(client->fd, 10, &done, sizeof(status)) == 1){  // Send DONE.
+            fprintf(stderr, "ERROR: Couldn't send DONE.\n");
+            return 1;
+        }
+        client->confirmed = client->frames.messages;
+    }
+    return code;
+}
+
 
-// TCP server lifetime.
-int tcp_server(int socket_fd){
-    bool connected = false;          // Connected to any user.
-    bool conacc = false;             // Accepted connection from connected user.
-    int client_fd;                   // Connected user's socket.
-    uint64_t size;         // Size of client's message.
-    uint64_t sess_id;      // Client's session ID.
-    uint64_t pack_id = 0;  // ID of next package.
+// Handles getting new packages, reads as much as the socket has with one syscall.
+// Returns 0 if client should send more, 1 on error and 2 if whole message was read.
+int tcp_handle(tcp_clients *all, tcp_client *client, output *out, server_config const *config){
+    out->failed = false;  // Output is flushed after every client, so failures are its own.
     for (;;){
-        if (!connected){  // Connecting with the new client.
-            struct sockaddr_in client_address;
-            client_fd = accept(socket_fd, (struct sockaddr*) &client_address, &((socklen_t){sizeof(client_address)}));
-            if (client_fd < 0){
-                fprintf(stderr, "ERROR: Couldn't connect with the client.\n");
+        bool splice = all->splice && !client->framed && client->transfer == NULL;
+        if (splice && client->header && client->payload > 0){
+            int code = tcp_splice(all, client, out);
+            if (code != 3){
+                return code;
+            }
+            code = tcp_finish(client, out, config);
+            if (code != 0){
+                return code;
+            }
+        }
+        struct iovec parts[2];
+        int count = ring_space(&client->input, parts);
+        size_t space = parts[0].iov_len + (count == 2 ? parts[1].iov_len : 0);
+        if (splice){  // Only headers are read, data is spliced.
+            size_t header = client->conacc ? sizeof(uint8_t) + sizeof(data_msg) : tcp_conn_size(&client->input);
+            space = header - ring_used(&client->input);
+            if (parts[0].iov_len >= space){
+                parts[0].iov_len = space;
+                count = 1;
             }
             else{
-                connected = true;
-
-                // Setting timeout on the socket.
-                struct timeval timeout;
-                timeout.tv_sec = MAX_WAIT;
-                timeout.tv_usec = 0;
-                if (setsockopt (client_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof timeout) < 0){
-                    tcp_disconnect(&connected, &conacc, &pack_id, client_fd);
-                    fprintf(stderr, "ERROR: Couldn't set timeout on the socket.\n");
-                }
+                parts[1].iov_len = space - parts[0].iov_len;
             }
         }
-        else{  // User connected to server.
-            if (!conacc){  // User not permitted to send yet.
-                int receive = tcp_handle(client_fd, &sess_id, &size, 1, 0);  // Receive CONN.
-                if (receive == 1){  // Message receive problem.
-                    tcp_disconnect(&connected, &conacc, &pack_id, client_fd);
-                }
-                else{  // CONN received.
-                    static char to_send[sizeof(uint8_t) + sizeof(base)];
-                    conacc = true;
-                    uint8_t id = 2;
-                    base acc;
-                    create_base(&acc, sess_id);
-                    memcpy(to_send, &id, sizeof(uint8_t));
-                    memcpy(to_send + sizeof(uint8_t), &acc, sizeof(base));
-                    if (tcp_write(client_fd, to_send, sizeof(uint8_t) + sizeof(base)) == 1){  // Send CONACC.
-                        tcp_disconnect(&connected, &conacc, &pack_id, client_fd);
-                        fprintf(stderr, "ERROR: Couldn't send CONACC\n");
-                    }
-                }
+        ssize_t done = readv(client->fd, parts, count);
+        client->reads++;
+        if (done < 0){
+            if (errno == EAGAIN || errno == EWOULDBLOCK){  // Everything was read.
+                return 0;
             }
-            else{  // User permitted to send.
-                int read = tcp_handle(client_fd, &sess_id, &size, 4, pack_id);  // Receive new data.
-                if (read == 1) {  // Message receive problem.
-                    tcp_disconnect(&connected, &conacc, &pack_id, client_fd);
-                }
-                else{  // Message got.
-                    pack_id++;
-                    if (size == 0){  // If whole message was read.
-                        static char to_send[sizeof(uint8_t) + sizeof(base)];
-                        uint8_t id = 7;
-                        base rcvd;
-                        create_base(&rcvd, sess_id);
-                        memcpy(to_send, &id, sizeof(uint8_t));
-                        memcpy(to_send + sizeof(uint8_t), &rcvd, sizeof(base));
-                        int write = tcp_write(client_fd, to_send, sizeof(uint8_t) + sizeof(base));  // Send RCVD.
-                        if (write == 1){
-                            fprintf(stderr, "ERROR: Couldn't send recv\n");
-                        }
-                        tcp_disconnect(&connected, &conacc, &pack_id, client_fd);
-                    }
-                }
+            fprintf(stderr, "ERROR: Couldn't read message.\n");
+            return 1;
+        }
+        else if (done == 0){
+            fprintf(stderr, "ERROR: Client already closed the socket.\n");
+            return 1;
+        }
+        client->input.tail += done;
+        tcp_deadline(all, client, mono_us() + client->wait);  // Time spent writing doesn't count.
+        int code = tcp_progress(all, client, out, config);
+        if (code != 0 || client->parked || (size_t) done < space){  // Socket had less than the ring could take, so it is empty.
+            return code;
+        }
+    }
+}
+
+
+// Accepts waiting clients, as long as there are free places.
+void tcp_accept(int socket_fd, int epoll_fd, tcp_clients *all){
+    while (all->count < all->limit){
+        struct sockaddr_in client_address;
+        int client_fd = accept4(socket_fd, (struct sockaddr*) &client_address, &((socklen_t){sizeof(client_address)}), SOCK_NONBLOCK);
+        if (client_fd < 0){
+            if (errno != EAGAIN && errno != EWOULDBLOCK){
+                fprintf(stderr, "ERROR: Couldn't connect with the client.\n");
             }
+            return;
         }
+        tcp_client *client = malloc(sizeof(tcp_client));
+        if (malloc_error(client) == 1){
+            close(client_fd);
+            return;
+        }
+        if (ring_init(&client->input, TCP_RING) == 1){
+            close(client_fd);
+            free(client);
+            return;
+        }
+        client->fd = client_fd;
+        client->conacc = false;  // First package is CONN.
+        client->header = false;
+        client->framed = false;
+        framer_init(&client->frames);
+        client->transfer = NULL;
+        client->parked = false;
+        client->record.fd = -1;
+        client->confirmed = 0;
+        client->pack_id = 0;
+        client->max_payload = all->limits.payload;
+        client->wait = all->limits.timeout * 1000ULL;
+        client->reads = 0;
+        client->writes = 0;
+        struct epoll_event event = {.events = EPOLLIN, .data.ptr = client};
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client_fd, &event) < 0){
+            fprintf(stderr, "ERROR: Couldn't watch the client.\n");
+            close(client_fd);
+            ring_free(&client->input);
+            free(client);
+            continue;
+        }
+        client->index = all->count;
+        all->clients[all->count++] = client;
+        tcp_deadline(all, client, mono_us() + client->wait);
     }
-    return 0;
 }
 
 
-// Creates server with specified protocol.
-int main(int argc, char *argv[]) {
-    if (argc != 3) {  // Checks for 2 arguments.
-        fprintf(stderr, "ERROR: Expected arguments: %s <communication protocol> <port>\n", argv[0]);
+// Watches parked clients again once their stripes have room, or their transfer failed.
+// Packages already in the ring are handled, as more might not come. Returns true if some client was unparked.
+bool tcp_unpark(tcp_clients *all, output *out, server_config const *config){
+    bool unparked = false;
+    size_t i = 0;
+    while (i < all->count){
+        tcp_client *client = all->clients[i];
+        if (!client->parked || !transfer_room(client->transfer, client->stripe, client->payload)){
+            i++;
+            continue;
+        }
+        struct epoll_event event = {.events = EPOLLIN, .data.ptr = client};
+        if (epoll_ctl(all->epoll_fd, EPOLL_CTL_MOD, client->fd, &event) < 0){
+            fprintf(stderr, "ERROR: Couldn't watch the client.\n");
+        }
+        client->parked = false;
+        all->parked--;
+        unparked = true;
+        tcp_deadline(all, client, mono_us() + client->wait);
+        out->failed = false;
+        if (tcp_progress(all, client, out, config) != 0){  // Error or whole message was read.
+            tcp_disconnect(all, client);
+            continue;  // Last client was moved into 'i'.
+        }
+        i++;
+    }
+    return unparked;
+}
+
+
+// Disconnects clients which haven't sent anything in their timeout.
+void tcp_timeouts(tcp_clients *all){
+    uint64_t now = mono_us();
+    all->next_sweep = UINT64_MAX;
+    size_t i = 0;
+    while (i < all->count){
+        tcp_client *client = all->clients[i];
+        if (client->deadline <= now){
+            fprintf(stderr, "ERROR: Message timeout.\n");
+            tcp_disconnect(all, client);
+            continue;  // Last client was moved into 'i'.
+        }
+        if (client->deadline < all->next_sweep){
+            all->next_sweep = client->deadline;
+        }
+        i++;
+    }
+}
+
+
+// TCP server lifetime.
+// Every client has its own state, sockets are non-blocking and watched with epoll.
+int tcp_server(int socket_fd, server_config const *config){
+    tcp_clients all = {.count = 0, .limit = config->max_sessions, .next_sweep = UINT64_MAX, .splice = false, .pipe_fds = {-1, -1}, .fallback = NULL,
+                       .limits = {.payload = config->payload, .timeout = config->timeout, .messages = 1, .stripes = STRIPES_MAX,
+                                  .resume = config->checkpoints >= 0}, .checkpoints = config->checkpoints};
+    all.clients = malloc(all.limit * sizeof(tcp_client *));
+    if (malloc_error(all.clients) == 1){
         return 1;
     }
-    char const *protocol = argv[1];  // Communication protocol.
-    bool error = false;
-    uint16_t port = read_port(argv[2], &error);
-    if (error){  // There was an error getting port.
+    if (pool_init(&all.held, config->window_buffers, BUFFOR_SIZE) == 1){
+        free(all.clients);
+        return 1;
+    }
+    if (transfers_init(&all.transfers, all.limit, &all.held) == 1){
+        free(all.clients);
+        pool_free(&all.held);
+        return 1;
+    }
+    if (config->splice){
+        all.fallback = malloc(BUFFOR_SIZE);
+        if (malloc_error(all.fallback) == 1){
+            free(all.clients);
+            transfers_free(&all.transfers);
+            pool_free(&all.held);
+            return 1;
+        }
+        if (pipe(all.pipe_fds) < 0){
+            fprintf(stderr, "ERROR: Couldn't create pipe, data won't be spliced.\n");
+        }
+        else{
+            all.splice = true;
+            fcntl(all.pipe_fds[1], F_SETPIPE_SZ, BUFFOR_SIZE);  // Pipe holds data of a whole package.
+        }
+    }
+    int epoll_fd = epoll_create1(0);
+    struct epoll_event event = {.events = EPOLLIN, .data.ptr = NULL};  // Listening socket has no client.
+    if (epoll_fd < 0 || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, socket_fd, &event) < 0){
+        fprintf(stderr, "ERROR: Couldn't create epoll.\n");
+        free(all.clients);
+        free(all.fallback);
+        transfers_free(&all.transfers);
+        pool_free(&all.held);
         return 1;
     }
+    all.epoll_fd = epoll_fd;
+    bool accepting = true;  // Listening socket is watched.
+    output out;  // Data waiting for stdout.
+    output_init(&out, OUTPUT_THRESHOLD, NULL);
+
+    for (;;){
+        struct timespec left = {0};
+        struct timespec *timeout = NULL;  // No clients, waiting for new connection lasts indefinitely.
+        if (all.count > 0 && all.next_sweep != UINT64_MAX){
+            uint64_t now = mono_us();
+            uint64_t wait = all.next_sweep > now ? all.next_sweep - now : 0;
+            left = (struct timespec) {.tv_sec = wait / 1000000, .tv_nsec = (wait % 1000000) * 1000};
+            timeout = &left;
+        }
+        struct epoll_event events[TCP_EVENTS];
+        int ready = epoll_pwait2(epoll_fd, events, TCP_EVENTS, timeout, NULL);
+        if (ready < 0 && errno != EINTR){
+            fprintf(stderr, "ERROR: Couldn't wait for messages.\n");
+            break;
+        }
+        for (int i = 0; i < ready; i++){
+            tcp_client *client = events[i].data.ptr;
+            if (client == NULL){  // New clients.
+                tcp_accept(socket_fd, epoll_fd, &all);
+            }
+            else if (tcp_handle(&all, client, &out, config) != 0){  // Error or whole message was read.
+                tcp_disconnect(&all, client);
+            }
+        }
+        if (mono_us() >= all.next_sweep){  // Some client might have timed out.
+            tcp_timeouts(&all);
+        }
+        while (all.parked > 0 && tcp_unpark(&all, &out, config)){}  // Unparked clients might make room for others.
 
-    int sock;  // Setting for the socket.
-    if (strcmp(protocol, "udp") == 0){  // UDP/UDPr
-        sock = SOCK_DGRAM;
+        // Waiting clients stay in the listen queue until some place is free.
+        if (accepting != (all.count < all.limit)){
+            accepting = !accepting;
+            event.events = accepting ? EPOLLIN : 0;
+            if (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, socket_fd, &event) < 0){
+                fprintf(stderr, "ERROR: Couldn't watch the listening socket.\n");
+            }
+            if (accepting){
+                tcp_accept(socket_fd, epoll_fd, &all);
+            }
+        }
     }
-    else{  // TCP
-        sock = SOCK_STREAM;
+    while (all.count > 0){
+        tcp_disconnect(&all, all.clients[0]);
     }
+    close(epoll_fd);
+    if (all.pipe_fds[0] >= 0){
+        close(all.pipe_fds[0]);
+        close(all.pipe_fds[1]);
+    }
+    free(all.fallback);
+    free(all.clients);
+    transfers_free(&all.transfers);
+    pool_free(&all.held);
+    return 1;
+}
 
-    // Create socket.
+
+// UDP worker, serves clients whose packages reach its socket.
+typedef struct udp_worker{
+    pthread_t thread;
+    int socket_fd;
+    server_config config;    // Settings with the worker's share of the session limit.
+    int cpu;                 // Core the worker is pinned to.
+} udp_worker;
+
+
+// Creates socket bound to 'port' on all interfaces. Returns -1 on error.
+// Sockets created with 'reuse' share the port, incoming packages are spread between them.
+int server_socket(int sock, uint16_t port, bool reuse){
     int socket_fd = socket(AF_INET, sock, 0);
     if (socket_fd < 0) {  // There was an error creating a socket.
         fprintf(stderr,"ERROR: Couldn't create a socket\n");
-        return 1;
+        return -1;
+    }
+    if (reuse && setsockopt(socket_fd, SOL_SOCKET, SO_REUSEPORT, &(int){1}, sizeof(int)) < 0){
+        fprintf(stderr, "ERROR: Couldn't share the port between sockets.\n");
+        close(socket_fd);
+        return -1;
     }
 
     // Bind the socket to an address.
@@ -469,27 +1792,212 @@ int main(int argc, char *argv[]) {
     // Binding.
     if (bind(socket_fd, (struct sockaddr *) &server_address, (socklen_t) sizeof(server_address)) < 0) {
         fprintf(stderr, "ERROR: Couldn't bind the socket.\n");
+        close(socket_fd);
+        return -1;
+    }
+
+    if (sock == SOCK_DGRAM){
+        // Packages of all clients queue in one socket, so its buffer is enlarged.
+        int buffer_size = SOCKET_BUFFER;
+        if (setsockopt(socket_fd, SOL_SOCKET, SO_RCVBUF, &buffer_size, sizeof(buffer_size)) < 0){
+            fprintf(stderr, "ERROR: Couldn't set receive buffer size of the socket.\n");
+        }
+    }
+    return socket_fd;
+}
+
+
+// Steers every package of a session to the same socket of the reuseport group.
+// Socket is chosen by the first four bytes of the session ID modulo number of workers,
+// so the workers never share session state. Packages too short to hold them go to the first worker.
+int steer_sessions(int socket_fd, size_t workers){
+    struct sock_filter code[] = {
+        BPF_STMT(BPF_LD | BPF_W | BPF_ABS, sizeof(uint8_t)),    // A = session ID bytes 0-3.
+        BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, (uint32_t) workers),  // A = A % workers.
+        BPF_STMT(BPF_RET | BPF_A, 0),                           // Socket with index A.
+    };
+    struct sock_fprog program = {.len = sizeof(code) / sizeof(code[0]), .filter = code};
+    if (setsockopt(socket_fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &program, sizeof(program)) < 0){
+        fprintf(stderr, "ERROR: Couldn't attach session steering program.\n");
         return 1;
     }
+    return 0;
+}
+
+
+// UDP worker thread lifetime.
+void *udp_worker_main(void *arg){
+    udp_worker *worker = arg;
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(worker->cpu, &cpus);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) != 0){
+        fprintf(stderr, "ERROR: Couldn't pin worker to core %d.\n", worker->cpu);
+    }
+    pthread_mutex_lock(&start_lock);
+    while (start_state == 0){
+        pthread_cond_wait(&start_cond, &start_lock);
+    }
+    bool serve = start_state == 1;
+    pthread_mutex_unlock(&start_lock);
+    if (serve){
+        udp_server(worker->socket_fd, &worker->config);
+    }
+    return NULL;
+}
 
-    if (strcmp(protocol, "udp") == 0){  // Communication protocol is UDP.
 
-        // Setting timeout on the socket.
-        struct timeval timeout;
-        timeout.tv_sec = MAX_WAIT;
-        timeout.tv_usec = 0;
-        if (setsockopt (socket_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof timeout) < 0){
-            fprintf(stderr, "ERROR: Couldn't set timeout on the socket.\n");
+// Runs UDP server in 'workers' threads, each with its own socket on the shared port.
+// Session limit is split between the workers.
+int udp_workers(uint16_t port, server_config const *config){
+    size_t workers = config->workers;
+    udp_worker *all = calloc(workers, sizeof(udp_worker));
+    if (malloc_error(all) == 1){
+        return 1;
+    }
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    int code = 0;
+    size_t created = 0;
+    for (; created < workers; created++){  // Sockets join the group in order, so index of socket is index of worker.
+        udp_worker *worker = &all[created];
+        worker->socket_fd = server_socket(SOCK_DGRAM, port, true);
+        if (worker->socket_fd < 0){
+            code = 1;
+            break;
+        }
+        if (created == 0 && steer_sessions(worker->socket_fd, workers) == 1){
+            close(worker->socket_fd);
+            code = 1;
+            break;
+        }
+        worker->config = *config;
+        worker->config.max_sessions = (config->max_sessions + workers - 1) / workers;
+        worker->config.window_buffers = (config->window_buffers + workers - 1) / workers;
+        worker->cpu = (int) (created % (cores > 0 ? (size_t) cores : 1));
+    }
+    size_t started = 0;
+    for (; started < created && code == 0; started++){
+        if (pthread_create(&all[started].thread, NULL, udp_worker_main, &all[started]) != 0){
+            fprintf(stderr, "ERROR: Couldn't start worker.\n");
+            code = 1;
+            break;
+        }
+    }
+    pthread_mutex_lock(&start_lock);
+    start_state = code == 0 ? 1 : -1;  // Started workers end at once if they won't serve.
+    pthread_cond_broadcast(&start_cond);
+    pthread_mutex_unlock(&start_lock);
+    for (size_t i = 0; i < started; i++){  // Sockets and workers are freed only after all threads ended.
+        pthread_join(all[i].thread, NULL);
+    }
+    for (size_t i = 0; i < created; i++){
+        close(all[i].socket_fd);
+    }
+    free(all);
+    return code;
+}
+
+
+// Creates server with specified protocol.
+int main(int argc, char *argv[]) {
+    static struct option const options[] = {
+        {"max-sessions", required_argument, NULL, 'm'},
+        {"workers", required_argument, NULL, 'w'},
+        {"batch", required_argument, NULL, 'b'},
+        {"stats", no_argument, NULL, 's'},
+        {"splice", no_argument, NULL, 'p'},
+        {"no-gro", no_argument, NULL, 'G'},
+        {"reorder", required_argument, NULL, 'r'},
+        {"payload", required_argument, NULL, 'l'},
+        {"timeout", required_argument, NULL, 't'},
+        {"checkpoints", required_argument, NULL, 'c'},
+        {NULL, 0, NULL, 0}
+    };
+    bool error = false;
+    server_config config = {.max_sessions = MAX_SESSIONS, .window_buffers = WINDOW_BUFFERS, .workers = 1, .batch = RECV_BATCH, .stats = false, .splice = false, .gro = true,
+                            .reorder = REORDER_WINDOW, .payload = BUFFOR_SIZE, .timeout = MAX_WAIT * 1000,
+                            .checkpoints = -1};
+    int option;
+    while ((option = getopt_long(argc, argv, "", options, NULL)) != -1){
+        if (option == 'm'){
+            config.max_sessions = read_number(optarg, 1, UINT32_MAX - 1, &error);
+        }
+        else if (option == 'w'){
+            config.workers = read_number(optarg, 1, MAX_WORKERS, &error);
+        }
+        else if (option == 'b'){
+            config.batch = read_number(optarg, 1, UIO_MAXIOV, &error);
+        }
+        else if (option == 's'){
+            config.stats = true;
+        }
+        else if (option == 'p'){
+            config.splice = true;
+        }
+        else if (option == 'G'){
+            config.gro = false;
+        }
+        else if (option == 'r'){
+            config.reorder = read_number(optarg, 0, NACK_WINDOW, &error);
+        }
+        else if (option == 'l'){
+            config.payload = read_number(optarg, PAYLOAD_MIN, BUFFOR_SIZE, &error);
+        }
+        else if (option == 't'){
+            config.timeout = read_number(optarg, TIMEOUT_MIN, TIMEOUT_MAX, &error);
+        }
+        else if (option == 'c'){  // Records describe what was written to stdout, so it should be appended to later.
+            if (config.checkpoints >= 0){
+                close(config.checkpoints);
+            }
+            config.checkpoints = open(optarg, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+            if (config.checkpoints < 0){
+                fprintf(stderr, "ERROR: Couldn't open directory %s.\n", optarg);
+                return 1;
+            }
+        }
+        else{
+            error = true;
+        }
+    }
+    if (error || argc - optind != 2) {  // Checks for 2 arguments.
+        fprintf(stderr, "ERROR: Expected arguments: %s <communication protocol> <port> [--max-sessions N] [--workers N] [--batch N] [--stats] [--splice] [--no-gro] [--reorder N]\n"
+                        "    [--payload N] [--timeout MS] [--checkpoints DIR]\n", argv[0]);
+        return 1;
+    }
+    char const *protocol = argv[optind];  // Communication protocol.
+    uint16_t port = read_port(argv[optind + 1], &error);
+    if (error){  // There was an error getting port.
+        return 1;
+    }
+
+    if (strcmp(protocol, "udp") == 0){  // Communication protocol is UDP.
+        if (config.workers > 1){  // Setting up UDP server on many cores.
+            return udp_workers(port, &config);
+        }
+        int socket_fd = server_socket(SOCK_DGRAM, port, false);
+        if (socket_fd < 0){
+            return 1;
         }
 
-        // Setting up UDP server.
-        if (udp_server(socket_fd) == 1){
+        // Setting up UDP server, timeouts are tracked per client.
+        if (udp_server(socket_fd, &config) == 1){
             close(socket_fd);
             return 1;
         }
         close(socket_fd);
     }
     else if (strcmp(protocol, "tcp") == 0){
+        int socket_fd = server_socket(SOCK_STREAM, port, false);
+        if (socket_fd < 0){
+            return 1;
+        }
+        struct sockaddr_in server_address;
+
+        // Clients holding a cookie may send CONN with SYN, if the system allows Fast Open for servers.
+        int queue = FASTOPEN_QUEUE;
+        setsockopt(socket_fd, IPPROTO_TCP, TCP_FASTOPEN, &queue, sizeof(queue));
+
         // Listening.
         if (listen(socket_fd, MAX_QUEUE) < 0){
             fprintf(stderr, "ERROR: Couldn't listen.\n");
@@ -500,8 +2008,20 @@ int main(int argc, char *argv[]) {
             fprintf(stderr, "ERROR: Couldn't find the port to listen on.\n");
         }
 
+        // Every client has its own socket, so descriptor limit is raised as far as allowed.
+        struct rlimit files;
+        if (getrlimit(RLIMIT_NOFILE, &files) == 0 && files.rlim_cur < files.rlim_max){
+            files.rlim_cur = files.rlim_max;
+            setrlimit(RLIMIT_NOFILE, &files);
+        }
+        int flags = fcntl(socket_fd, F_GETFL);
+        if (flags < 0 || fcntl(socket_fd, F_SETFL, flags | O_NONBLOCK) < 0){
+            fprintf(stderr, "ERROR: Couldn't make the socket non-blocking.\n");
+            return 1;
+        }
+
         // Setting up TCP server.
-        if (tcp_server(socket_fd) == 1){
+        if (tcp_server(socket_fd, &config) == 1){
             close(socket_fd);
             return 1;
         }
@@ -1,2 +1,39 @@
 #define MAX_WAIT 1
 #define MAX_RETRANSMITS 10
+
+#define MAX_SESSIONS 1024
+#define SOCKET_BUFFER (8 * 1024 * 1024)
+#define TCP_EVENTS 256
+#define MAX_WORKERS 256
+#define RECV_BATCH 32
+#define STATS_INTERVAL 1
+#define SEND_BATCH 32
+#define TCP_RING (1 << 18)
+#define OUTPUT_THRESHOLD (1 << 20)
+#define READ_AHEAD (1 << 23)
+#define WINDOW 64
+#define WINDOW_BUFFERS 2048
+#define NACK_WINDOW 1024
+#define NACK_RANGES 64
+#define NACK_EVERY 2
+#define NACK_INTERVAL 1000
+#define RTO_MIN 200
+#define FEC_BLOCK 8
+#define CC_INITIAL_WINDOW 10
+#define DELAY_ALPHA 2
+#define DELAY_BETA 4
+#define PACING_BURST 1000
+#define PAYLOAD_MIN 512
+#define PAYLOAD_PERIOD 256
+#define PAYLOAD_LOSS_HIGH 5
+#define PAYLOAD_LOSS_LOW 1
+#define REORDER_WINDOW 64
+#define REORDER_TIMEOUT 100000
+#define GSO_SEGMENTS 64
+#define FASTOPEN_QUEUE 256
+#define TIMEOUT_MIN 100
+#define TIMEOUT_MAX 600000
+#define SESSION_POLL 64
+#define GSO_BYTES 65507
+#define STRIPES_MAX 64
+#define STRIPE_BUFFERS 256
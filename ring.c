@@ -0,0 +1,65 @@
+#include <string.h>
+#include "common.h"
+#include "ring.h"
+
+
+// Allocates ring of 'capacity' bytes, which must be a power of two.
+int ring_init(ring *buffer, size_t capacity){
+    buffer->data = malloc(capacity);
+    if (malloc_error(buffer->data) == 1){
+        return 1;
+    }
+    buffer->mask = capacity - 1;
+    buffer->head = 0;
+    buffer->tail = 0;
+    return 0;
+}
+
+
+// Frees ring memory.
+void ring_free(ring *buffer){
+    free(buffer->data);
+}
+
+
+// Number of bytes in the ring.
+size_t ring_used(ring const *buffer){
+    return buffer->tail - buffer->head;
+}
+
+
+// Describes 'len' bytes from position 'from' with at most two buffers. Returns their number.
+static int ring_range(ring *buffer, uint64_t from, size_t len, struct iovec parts[2]){
+    size_t start = from & buffer->mask;
+    size_t first = buffer->mask + 1 - start;  // Bytes until the end of memory.
+    if (len <= first){
+        parts[0] = (struct iovec) {.iov_base = buffer->data + start, .iov_len = len};
+        return 1;
+    }
+    parts[0] = (struct iovec) {.iov_base = buffer->data + start, .iov_len = first};
+    parts[1] = (struct iovec) {.iov_base = buffer->data, .iov_len = len - first};
+    return 2;
+}
+
+
+// Describes free space of the ring with at most two buffers. Returns their number.
+int ring_space(ring *buffer, struct iovec parts[2]){
+    return ring_range(buffer, buffer->tail, buffer->mask + 1 - ring_used(buffer), parts);
+}
+
+
+// Describes 'len' bytes starting 'offset' bytes after head with at most two buffers. Returns their number.
+int ring_parts(ring *buffer, size_t offset, size_t len, struct iovec parts[2]){
+    return ring_range(buffer, buffer->head + offset, len, parts);
+}
+
+
+// Copies 'len' bytes starting 'offset' bytes after head to 'to'.
+void ring_peek(ring *buffer, size_t offset, void *to, size_t len){
+    struct iovec parts[2];
+    int count = ring_parts(buffer, offset, len, parts);
+    memcpy(to, parts[0].iov_base, parts[0].iov_len);
+    if (count == 2){
+        memcpy((char *) to + parts[0].iov_len, parts[1].iov_base, parts[1].iov_len);
+    }
+}
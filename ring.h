@@ -0,0 +1,34 @@
+#ifndef RING_H
+#define RING_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/uio.h>
+
+// Byte ring buffer. Positions only grow, they are wrapped with 'mask' when used.
+typedef struct ring{
+    char *data;
+    size_t mask;             // Capacity - 1, capacity is a power of two.
+    uint64_t head;           // Position of the first unread byte.
+    uint64_t tail;           // Position after the last written byte.
+} ring;
+
+// Allocates ring of 'capacity' bytes, which must be a power of two.
+int ring_init(ring *buffer, size_t capacity);
+
+// Frees ring memory.
+void ring_free(ring *buffer);
+
+// Number of bytes in the ring.
+size_t ring_used(ring const *buffer);
+
+// Describes free space of the ring with at most two buffers. Returns their number.
+int ring_space(ring *buffer, struct iovec parts[2]);
+
+// Describes 'len' bytes starting 'offset' bytes after head with at most two buffers. Returns their number.
+int ring_parts(ring *buffer, size_t offset, size_t len, struct iovec parts[2]);
+
+// Copies 'len' bytes starting 'offset' bytes after head to 'to'.
+void ring_peek(ring *buffer, size_t offset, void *to, size_t len);
+
+#endif
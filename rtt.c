@@ -0,0 +1,56 @@
+#include "common.h"
+#include "protconst.h"
+#include "rtt.h"
+
+#define RTO_MAX (MAX_WAIT * 1000000ULL)
+
+
+// Starts estimation at 'now', MAX_WAIT is used until the first sample.
+void rtt_init(rtt *timer, uint64_t now){
+    timer->srtt = 0;
+    timer->rttvar = 0;
+    timer->rto = RTO_MAX;
+    timer->progress = now;
+}
+
+
+// Updates estimation with round trip time measured at 'now'. Clears backoff.
+// Smoothing follows RFC 6298, with microsecond clock granularity.
+void rtt_sample(rtt *timer, uint64_t sample, uint64_t now){
+    sample = sample > 0 ? sample : 1;
+    if (timer->srtt == 0){  // First sample.
+        timer->srtt = sample;
+        timer->rttvar = sample / 2;
+    }
+    else{
+        uint64_t diff = timer->srtt > sample ? timer->srtt - sample : sample - timer->srtt;
+        timer->rttvar = (3 * timer->rttvar + diff) / 4;
+        timer->srtt = (7 * timer->srtt + sample) / 8;
+    }
+    timer->rto = timer->srtt + 4 * timer->rttvar;
+    if (timer->rto < RTO_MIN){
+        timer->rto = RTO_MIN;
+    }
+    else if (timer->rto > RTO_MAX){
+        timer->rto = RTO_MAX;
+    }
+    timer->progress = now;
+}
+
+
+// Notes confirmation which can't be measured, because it may answer a retransmission.
+void rtt_progress(rtt *timer, uint64_t now){
+    timer->progress = now;
+}
+
+
+// Doubles the timeout after a retransmission, up to MAX_WAIT.
+void rtt_backoff(rtt *timer){
+    timer->rto = timer->rto * 2 < RTO_MAX ? timer->rto * 2 : RTO_MAX;
+}
+
+
+// Peer confirmed nothing for MAX_WAIT * MAX_RETRANSMITS seconds.
+bool rtt_expired(rtt const *timer, uint64_t now){
+    return now - timer->progress >= RTO_MAX * MAX_RETRANSMITS;
+}
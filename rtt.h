@@ -0,0 +1,31 @@
+#ifndef RTT_H
+#define RTT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Round trip time estimation of a peer, gives the retransmission timeout.
+typedef struct rtt{
+    uint64_t srtt;           // Smoothed round trip time (us), 0 before the first sample.
+    uint64_t rttvar;         // Variation of round trip time (us).
+    uint64_t rto;            // Retransmission timeout (us), doubled by every backoff.
+    uint64_t progress;       // Time (us) of the last confirmation from the peer.
+} rtt;
+
+// Starts estimation at 'now', MAX_WAIT is used until the first sample.
+void rtt_init(rtt *timer, uint64_t now);
+
+// Updates estimation with round trip time measured at 'now'. Clears backoff.
+void rtt_sample(rtt *timer, uint64_t sample, uint64_t now);
+
+// Notes confirmation which can't be measured, because it may answer a retransmission.
+void rtt_progress(rtt *timer, uint64_t now);
+
+// Doubles the timeout after a retransmission, up to MAX_WAIT.
+void rtt_backoff(rtt *timer);
+
+// Peer confirmed nothing for MAX_WAIT * MAX_RETRANSMITS seconds. It is a time budget, not a count: with
+// timeouts shorter than MAX_WAIT more than MAX_RETRANSMITS retransmissions are sent before giving up.
+bool rtt_expired(rtt const *timer, uint64_t now);
+
+#endif
@@ -0,0 +1,168 @@
+#include <string.h>
+#include "common.h"
+#include "session.h"
+
+
+// Mixes session ID bits, so close IDs land in distant slots.
+static size_t session_hash(uint64_t sess_id){
+    sess_id ^= sess_id >> 33;
+    sess_id *= 0xff51afd7ed558ccdULL;
+    sess_id ^= sess_id >> 33;
+    sess_id *= 0xc4ceb9fe1a85ec53ULL;
+    sess_id ^= sess_id >> 33;
+    return (size_t) sess_id;
+}
+
+
+// Allocates table for 'limit' sessions, which hold at most 'buffers' packages out of order.
+int sessions_init(session_table *table, size_t limit, size_t buffers){
+    size_t capacity = 16;
+    while (capacity < 2 * limit){  // Load factor is kept under 1/2.
+        capacity *= 2;
+    }
+    table->slots = malloc(capacity * sizeof(session_slot));
+    table->sessions = malloc((limit > 0 ? limit : 1) * sizeof(session));
+    table->done = malloc((limit > 0 ? limit : 1) * sizeof(uint64_t));  // Every session waits for DONE at most once.
+    if (malloc_error(table->slots) == 1 || malloc_error(table->sessions) == 1 || malloc_error(table->done) == 1 ||
+        pool_init(&table->window, buffers, BUFFOR_SIZE) == 1){
+        free(table->slots);
+        free(table->sessions);
+        free(table->done);
+        return 1;
+    }
+    if (transfers_init(&table->transfers, limit, &table->window) == 1){  // Every transfer has a session.
+        sessions_free(table);
+        return 1;
+    }
+    for (size_t i = 0; i < capacity; i++){
+        table->slots[i].index = SLOT_EMPTY;
+    }
+    table->mask = capacity - 1;
+    table->count = 0;
+    table->limit = limit;
+    table->next_sweep = UINT64_MAX;
+    table->reorder = 0;
+    table->limits = (capabilities) {.payload = BUFFOR_SIZE, .window = WINDOW, .timeout = MAX_WAIT * 1000, .messages = 1, .stripes = STRIPES_MAX};
+    table->done_count = 0;
+    table->checkpoints = -1;
+    return 0;
+}
+
+
+// Frees table memory.
+void sessions_free(session_table *table){
+    free(table->slots);
+    free(table->sessions);
+    free(table->done);
+    pool_free(&table->window);
+    transfers_free(&table->transfers);
+}
+
+
+// Finds slot of the session with given ID, or first empty slot on its probe path.
+static size_t session_slot_of(session_table *table, uint64_t sess_id){
+    size_t i = session_hash(sess_id) & table->mask;
+    while (table->slots[i].index != SLOT_EMPTY && table->slots[i].sess_id != sess_id){
+        i = (i + 1) & table->mask;
+    }
+    return i;
+}
+
+
+// Finds session with given ID, NULL if there is none.
+session *session_find(session_table *table, uint64_t sess_id){
+    size_t i = session_slot_of(table, sess_id);
+    if (table->slots[i].index == SLOT_EMPTY){
+        return NULL;
+    }
+    return &table->sessions[table->slots[i].index];
+}
+
+
+// Adds new session with given ID. Returns NULL if the session limit is reached.
+session *session_insert(session_table *table, uint64_t sess_id){
+    if (table->count >= table->limit){
+        return NULL;
+    }
+    size_t i = session_slot_of(table, sess_id);
+    if (table->slots[i].index != SLOT_EMPTY){  // Already in the table.
+        return &table->sessions[table->slots[i].index];
+    }
+    session *s = &table->sessions[table->count];
+    memset(s, 0, sizeof(session));
+    s->sess_id = sess_id;
+    table->slots[i].sess_id = sess_id;
+    table->slots[i].index = table->count;
+    table->count++;
+    return s;
+}
+
+
+// Lets session hold up to 'span' packages received out of order.
+int session_span(session *s, uint32_t span){
+    s->held = malloc(span * sizeof(uint32_t));
+    s->held_len = malloc(span * sizeof(uint32_t));
+    if (malloc_error(s->held) == 1 || malloc_error(s->held_len) == 1){
+        free(s->held);
+        free(s->held_len);
+        s->held = NULL;
+        s->held_len = NULL;
+        return 1;
+    }
+    for (uint32_t j = 0; j < span; j++){
+        s->held[j] = POOL_NONE;
+    }
+    s->span = span;
+    return 0;
+}
+
+
+// Removes session from the table, its held packages and parity return to the pool.
+// Pointers to other sessions may be invalidated.
+void session_remove(session_table *table, session *s){
+    for (uint32_t j = 0; j < s->span; j++){
+        if (s->held[j] != POOL_NONE){
+            pool_put(&table->window, s->held[j]);
+        }
+    }
+    if (s->fec && s->parity != POOL_NONE){
+        pool_put(&table->window, s->parity);
+    }
+    free(s->held);
+    free(s->held_len);
+    size_t i = session_slot_of(table, s->sess_id);
+    uint32_t index = table->slots[i].index;
+
+    // Backward shift deletion, keeps probe paths of following keys intact.
+    size_t j = i;
+    for (;;){
+        j = (j + 1) & table->mask;
+        if (table->slots[j].index == SLOT_EMPTY){
+            break;
+        }
+        size_t home = session_hash(table->slots[j].sess_id) & table->mask;
+        // Moves 'j' into the hole, if its home isn't cyclically in (i, j].
+        if ((j > i && (home <= i || home > j)) || (j < i && (home <= i && home > j))){
+            table->slots[i] = table->slots[j];
+            i = j;
+        }
+    }
+    table->slots[i].index = SLOT_EMPTY;
+
+    // Keeps session array dense by moving the last session into the gap.
+    table->count--;
+    if (index != table->count){
+        table->sessions[index] = table->sessions[table->count];
+        size_t moved = session_slot_of(table, table->sessions[index].sess_id);
+        table->slots[moved].index = index;
+    }
+}
+
+
+// Sets new timeout of the session.
+void session_deadline(session_table *table, session *s, uint64_t deadline){
+    s->deadline = deadline;
+    if (deadline < table->next_sweep){
+        table->next_sweep = deadline;
+    }
+}
@@ -0,0 +1,104 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <netinet/in.h>
+#include "protconst.h"
+#include "common.h"
+#include "pool.h"
+#include "rtt.h"
+#include "fec.h"
+#include "frame.h"
+#include "stripe.h"
+#include "checkpoint.h"
+
+// State of one UDP/UDPR client connected to the server.
+typedef struct session{
+    uint64_t sess_id;            // Session ID of the client.
+    uint64_t unpack;             // Number of bytes left to receive.
+    uint64_t last;               // ID of the next expected package.
+    uint64_t trials;             // Retransmissions since the last correct package.
+    uint64_t deadline;           // Monotonic time (us) of the next timeout.
+    uint64_t sent_at;            // Monotonic time (us) of the last confirmation sent to UDPR client.
+    rtt timer;                   // Round trip time estimation of UDPR client.
+    struct sockaddr_in client;   // Address of the client.
+    bool udpr;                   // Client uses UDPR.
+    bool windowed;               // Client keeps a window of unconfirmed packages.
+    bool nack;                   // Client streams packages and sends again those listed in NACKs.
+    bool stream;                 // Length is unknown, message ends with an empty DATA.
+    bool fec;                    // UDP client sends PARITY after every block of packages.
+    bool ext;                    // Client offered capabilities, CONNACC carries 'agreed'.
+    bool framed;                 // Stream carries messages, each confirmed with DONE once written.
+    bool done_queued;            // Session waits in the table for its DONE or record of its progress.
+    framer frames;               // Messages of framed stream.
+    transfer *transfer;          // Striped transfer the session sends a range of, NULL if it sends a whole message.
+    uint32_t stripe;             // Index of its range.
+    checkpoint record;           // Progress of resumable transfer.
+    uint64_t resumed;            // Bytes of the message written by earlier sessions of the transfer.
+    capabilities agreed;         // Capabilities agreed to, 0 where client kept the default.
+    uint32_t max_payload;        // Max data size of DATA.
+    uint64_t wait;               // Time (us) without packages after which UDP client is disconnected.
+    fec_block block;             // Packages of the current block received from FEC client.
+    uint32_t parity;             // Pool buffer with XOR of their data.
+    uint64_t highest;            // After the highest package received from NACK or plain UDP client.
+    uint64_t gap_since;          // Monotonic time (us) plain UDP client's oldest gap was noticed.
+    uint32_t unconfirmed;        // Packages received from NACK client since the last NACK.
+    uint32_t span;               // Packages may be held up to 'span' after 'last', 0 if they must come in order.
+    uint32_t *held;              // Pool buffers of packages received ahead of 'last', by package ID % span.
+    uint32_t *held_len;          // Data sizes of held packages.
+} session;
+
+// Hash table slot, points to a session in the dense session array.
+typedef struct session_slot{
+    uint64_t sess_id;
+    uint32_t index;              // SLOT_EMPTY if slot is free.
+} session_slot;
+
+// Sessions of all connected clients.
+// Slots are probed linearly and only hold the key with the index of the session,
+// so a lookup touches a single cache line in the common case.
+typedef struct session_table{
+    session_slot *slots;         // Open addressing table, capacity is a power of two.
+    session *sessions;           // Dense array of 'count' sessions.
+    size_t mask;                 // Capacity of 'slots' - 1.
+    size_t count;                // Number of connected clients.
+    size_t limit;                // Max number of connected clients.
+    uint64_t next_sweep;         // No session times out before that time (us).
+    pool window;                 // Buffers of packages received out of order and of stripes behind their head, shared by all sessions.
+    uint32_t reorder;            // Packages plain UDP sessions may hold ahead of a gap, 0 if they must come in order.
+    capabilities limits;         // Most the server agrees to, limits of clients which don't negotiate too.
+    uint64_t *done;              // Framed sessions with messages written since their last DONE and resumable ones with new data,
+                                 // DONE is sent and progress recorded after the output is flushed.
+    size_t done_count;
+    transfers transfers;         // Striped transfers, ranges sent by sessions of this table.
+    int checkpoints;             // Directory of records of resumable transfers, -1 if transfers aren't resumed.
+    output *out;                 // Output of the batch, sessions which end record only data it has written.
+} session_table;
+
+#define SLOT_EMPTY UINT32_MAX
+
+// Allocates table for 'limit' sessions, which hold at most 'buffers' packages out of order.
+int sessions_init(session_table *table, size_t limit, size_t buffers);
+
+// Frees table memory.
+void sessions_free(session_table *table);
+
+// Finds session with given ID, NULL if there is none.
+session *session_find(session_table *table, uint64_t sess_id);
+
+// Adds new session with given ID. Returns NULL if the session limit is reached.
+session *session_insert(session_table *table, uint64_t sess_id);
+
+// Lets session hold up to 'span' packages received out of order.
+int session_span(session *s, uint32_t span);
+
+// Removes session from the table, its held packages and parity return to the pool.
+// Pointers to other sessions may be invalidated.
+void session_remove(session_table *table, session *s);
+
+// Sets new timeout of the session.
+void session_deadline(session_table *table, session *s, uint64_t deadline);
+
+#endif
@@ -0,0 +1,185 @@
+#include "common.h"
+#include "stripe.h"
+
+
+// Allocates list of at most 'limit' transfers, which hold data in buffers of 'held'.
+int transfers_init(transfers *list, size_t limit, pool *held){
+    list->count = 0;
+    list->limit = limit;
+    list->held = held;
+    list->all = malloc((limit > 0 ? limit : 1) * sizeof(transfer *));  // Empty list may be freed if it fails.
+    return malloc_error(list->all);
+}
+
+
+// Returns buffers held by the stripe to the pool.
+static void stripe_release(transfer *t, stripe *part){
+    for (uint32_t i = 0; i < part->used; i++){
+        pool_put(t->held, part->buffers[i]);
+    }
+    part->used = 0;
+    part->filled = 0;
+}
+
+
+// Frees transfer, held data of its stripes returns to the pool.
+static void transfer_free(transfer *t){
+    for (uint32_t i = 0; i < t->count; i++){
+        stripe_release(t, &t->stripes[i]);
+    }
+    free(t->stripes);
+    free(t);
+}
+
+
+// Frees list and transfers left in it.
+void transfers_free(transfers *list){
+    for (size_t i = 0; i < list->count; i++){
+        transfer_free(list->all[i]);
+    }
+    free(list->all);
+}
+
+
+// Removes transfer from the list and frees it.
+static void transfer_drop(transfers *list, transfer *t){
+    for (size_t i = 0; i < list->count; i++){
+        if (list->all[i] == t){
+            list->all[i] = list->all[--list->count];
+            break;
+        }
+    }
+    transfer_free(t);
+}
+
+
+// Creates transfer of 'count' stripes and adds it to the list. Returns NULL if the list is full or there is no memory.
+static transfer *transfer_create(transfers *list, uint32_t id, uint32_t count){
+    if (list->count >= list->limit){
+        return NULL;
+    }
+    transfer *t = malloc(sizeof(transfer));
+    stripe *stripes = calloc(count, sizeof(stripe));
+    if (malloc_error(t) == 1 || malloc_error(stripes) == 1){
+        free(t);
+        free(stripes);
+        return NULL;
+    }
+    *t = (transfer) {.id = id, .count = count, .members = 0, .head = 0, .failed = false, .held = list->held, .stripes = stripes};
+    list->all[list->count++] = t;
+    return t;
+}
+
+
+// Joins stripe 'index' of 'count' with range of 'len' bytes to transfer 'id', which is created by its first stripe.
+// Returns NULL if the stripe doesn't fit the transfer or there is no memory.
+transfer *transfer_join(transfers *list, uint32_t id, uint32_t count, uint32_t index, uint64_t len){
+    transfer *t = NULL;
+    for (size_t i = 0; i < list->count && t == NULL; i++){
+        t = list->all[i]->id == id ? list->all[i] : NULL;
+    }
+    if (t == NULL){
+        t = transfer_create(list, id, count);
+    }
+    if (t == NULL || t->count != count || index >= count || t->stripes[index].joined || t->failed){
+        return NULL;
+    }
+    stripe *part = &t->stripes[index];
+    part->len = len;
+    part->joined = true;
+    t->members++;
+    return t;
+}
+
+
+// Checks if 'len' more bytes of stripe 'index' can be passed now. Stripe behind the head needs free buffers for them.
+// Failed transfer has room, so its stripes learn about the failure.
+bool transfer_room(transfer const *t, uint32_t index, size_t len){
+    if (t->failed || index == t->head){
+        return true;
+    }
+    stripe const *part = &t->stripes[index];
+    size_t size = t->held->buffer_size;
+    uint64_t needed = (part->filled + len + size - 1) / size;  // Buffers holding all its data.
+    return needed <= STRIPE_BUFFERS && needed - part->used <= t->held->available;
+}
+
+
+// Passes data of stripe 'index' to the output, or holds it until the stripe becomes the head.
+// Held data which doesn't have room is an error.
+int transfer_push(transfer *t, uint32_t index, output *out, char *data, size_t len){
+    if (t->failed){
+        fprintf(stderr, "ERROR: Another stripe of the transfer failed.\n");
+        return 1;
+    }
+    if (index == t->head){
+        return output_push(out, data, len);
+    }
+    stripe *part = &t->stripes[index];
+    if (len > part->len - part->filled){
+        fprintf(stderr, "ERROR: Stripe is longer than its range.\n");
+        return 1;
+    }
+    if (!transfer_room(t, index, len)){
+        fprintf(stderr, "ERROR: No room to hold data of the stripe.\n");
+        return 1;
+    }
+    size_t size = t->held->buffer_size;
+    while (len > 0){
+        size_t offset = part->filled % size;
+        if (offset == 0){  // Last buffer is full.
+            part->buffers[part->used++] = pool_get(t->held);
+        }
+        size_t piece = size - offset < len ? size - offset : len;
+        memcpy(pool_buffer(t->held, part->buffers[part->used - 1]) + offset, data, piece);
+        part->filled += piece;
+        data += piece;
+        len -= piece;
+    }
+    return 0;
+}
+
+
+// Notes that range of stripe 'index' was received whole. Stripes it held back are written and the output is flushed,
+// so their buffers return to the pool. The next stripe not received whole becomes the head, its data goes to the output.
+int transfer_whole(transfer *t, uint32_t index, output *out){
+    t->stripes[index].whole = true;
+    if (index != t->head){
+        return 0;
+    }
+    t->head++;
+    while (t->head < t->count){
+        stripe *part = &t->stripes[t->head];
+        size_t size = t->held->buffer_size;
+        for (uint32_t i = 0; i < part->used; i++){
+            uint64_t piece = part->filled - (uint64_t) i * size;
+            if (output_push(out, pool_buffer(t->held, part->buffers[i]), piece < size ? piece : size) == 1){
+                return 1;
+            }
+        }
+        if (!part->whole){
+            break;
+        }
+        t->head++;
+    }
+    int code = output_flush(out);
+    for (uint32_t i = 0; i <= t->head && i < t->count; i++){  // Written data isn't needed, the head gets new data directly.
+        stripe_release(t, &t->stripes[i]);
+    }
+    return code;
+}
+
+
+// Checks if all stripes are written.
+bool transfer_done(transfer const *t){
+    return t->head == t->count;
+}
+
+
+// Removes session of stripe 'index'. Transfer fails if the range wasn't received whole, it is freed with its last session.
+void transfer_leave(transfers *list, transfer *t, uint32_t index){
+    t->failed = t->failed || !t->stripes[index].whole;
+    if (--t->members == 0){
+        transfer_drop(list, t);
+    }
+}
@@ -0,0 +1,68 @@
+#ifndef STRIPE_H
+#define STRIPE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "protconst.h"
+#include "output.h"
+#include "pool.h"
+
+// Byte range of a striped transfer, sent by one client session.
+typedef struct stripe{
+    uint32_t buffers[STRIPE_BUFFERS];  // Pool buffers holding data received before the stripe became the head.
+    uint32_t used;           // Buffers taken, they are filled in order.
+    uint64_t len;            // Size of the range.
+    uint64_t filled;         // Bytes held in 'buffers'.
+    bool joined;             // Session of the stripe has connected.
+    bool whole;              // Whole range was received.
+} stripe;
+
+// Logical transfer split into byte ranges sent in parallel.
+// Data of the head stripe goes to the output directly, later stripes are held until it is written whole.
+// Every stripe holds at most STRIPE_BUFFERS buffers, a stripe without room has to wait for the head.
+typedef struct transfer{
+    uint32_t id;             // First four bytes of session IDs of its stripes.
+    uint32_t count;          // Number of stripes.
+    uint32_t members;        // Sessions of stripes which are connected.
+    uint32_t head;           // First stripe not written whole, 'count' when the transfer is written.
+    bool failed;             // Session of a stripe ended before its range was received, nothing more is written.
+    pool *held;              // Pool the held data is taken from.
+    stripe *stripes;
+} transfer;
+
+// Striped transfers in progress.
+typedef struct transfers{
+    transfer **all;
+    size_t count;
+    size_t limit;
+    pool *held;              // Pool held data of stripes is taken from, shared with other users.
+} transfers;
+
+// Allocates list of at most 'limit' transfers, which hold data in buffers of 'held'.
+int transfers_init(transfers *list, size_t limit, pool *held);
+
+// Frees list and transfers left in it.
+void transfers_free(transfers *list);
+
+// Joins stripe 'index' of 'count' with range of 'len' bytes to transfer 'id', which is created by its first stripe.
+// Returns NULL if the stripe doesn't fit the transfer or there is no memory.
+transfer *transfer_join(transfers *list, uint32_t id, uint32_t count, uint32_t index, uint64_t len);
+
+// Checks if 'len' more bytes of stripe 'index' can be passed now. Stripe behind the head needs free buffers for them.
+bool transfer_room(transfer const *t, uint32_t index, size_t len);
+
+// Passes data of stripe 'index' to the output, or holds it until the stripe becomes the head.
+// Held data which doesn't have room is an error.
+int transfer_push(transfer *t, uint32_t index, output *out, char *data, size_t len);
+
+// Notes that range of stripe 'index' was received whole. Stripes it held back are written and the output is flushed.
+int transfer_whole(transfer *t, uint32_t index, output *out);
+
+// Checks if all stripes are written.
+bool transfer_done(transfer const *t);
+
+// Removes session of stripe 'index'. Transfer fails if the range wasn't received whole, it is freed with its last session.
+void transfer_leave(transfers *list, transfer *t, uint32_t index);
+
+#endif